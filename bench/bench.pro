@@ -0,0 +1,90 @@
+# -------------------------------------------------
+# QTestLib benchmarks for the event ingestion, model and user list paths
+#   qmake && make && ./bench_hot_paths
+# results are written to bench_results.xml unless -o is given
+# -------------------------------------------------
+# QT libs we need
+QT += network \
+    script
+CONFIG += qtestlib
+
+# basic app config
+TARGET = bench_hot_paths
+TEMPLATE = app
+CONFIG -= app_bundle
+debug:DESTDIR = ../bin/debug
+release:DESTDIR = ../bin/release
+
+# where to put all the temporary crap
+OBJECTS_DIR = ../bin/temp/bench
+MOC_DIR = ../bin/temp/bench
+RCC_DIR = ../bin/temp/bench
+UI_HEADERS_DIR = ../bin/temp/bench
+
+# where to find files, the app sources are built in as-is
+DEPENDPATH += ../inc \
+    ../src \
+    ../ui \
+    ../resources
+INCLUDEPATH += ../inc \
+    ../bin/temp/bench
+
+# what files to find
+SOURCES += bench_hot_paths.cpp \
+    ../src/main_window.cpp \
+    ../src/talker_account.cpp \
+    ../src/talker_room.cpp \
+    ../src/options_dialog.cpp \
+    ../src/talker_user.cpp \
+    ../src/settings_store.cpp \
+    ../src/event_journal.cpp \
+    ../src/event_filter.cpp \
+    ../src/process_stats.cpp \
+    ../src/wire_capture.cpp \
+    ../src/latency_tracer.cpp \
+    ../src/json_string.cpp \
+    ../src/diagnostics_dialog.cpp \
+    ../src/metrics.cpp \
+    ../src/room_view.cpp \
+    ../src/highlight_matcher.cpp \
+    ../src/room_registry.cpp \
+    ../src/notifier.cpp \
+    ../src/message_item.cpp \
+    ../src/text_arena.cpp \
+    ../src/chat_delegate.cpp \
+    ../src/chat_filter.cpp \
+    ../src/room_history.cpp \
+    ../src/transcript_export.cpp
+HEADERS += ../inc/main_window.h \
+    ../inc/talker_account.h \
+    ../inc/talker_room.h \
+    ../inc/custom_tab_widget.h \
+    ../inc/options_dialog.h \
+    ../inc/defines.h \
+    ../inc/talker_user.h \
+    ../inc/settings_store.h \
+    ../inc/event_journal.h \
+    ../inc/event_filter.h \
+    ../inc/process_stats.h \
+    ../inc/wire_capture.h \
+    ../inc/latency_tracer.h \
+    ../inc/json_string.h \
+    ../inc/diagnostics_dialog.h \
+    ../inc/memory_usage.h \
+    ../inc/metrics.h \
+    ../inc/room_view.h \
+    ../inc/highlight_matcher.h \
+    ../inc/room_registry.h \
+    ../inc/notifier.h \
+    ../inc/message_item.h \
+    ../inc/text_arena.h \
+    ../inc/chat_delegate.h \
+    ../inc/chat_filter.h \
+    ../inc/room_history.h \
+    ../inc/transcript_export.h
+FORMS += ../ui/main_window.ui \
+    ../ui/account_edit_dialog.ui \
+    ../ui/options_dialog.ui \
+    ../ui/about_dialog.ui
+win32:LIBS += -lpsapi # process memory stats
+RESOURCES += ../resources/icons.qrc
@@ -0,0 +1,216 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtGui>
+#include <QtNetwork>
+#include <QtScript>
+#include <QtTest>
+
+#include "main_window.h"
+#include "talker_account.h"
+#include "talker_room.h"
+#include "room_view.h"
+#include "talker_user.h"
+
+// users that messages in the benchmarks come from
+static const int SENDERS = 50;
+
+/**
+  * Benchmarks for the paths every incoming event goes through: splitting
+  * and parsing the socket stream, adding rows to a room's model, replacing
+  * a room's user list and redrawing the user list dock.
+  */
+class BenchHotPaths : public QObject {
+    Q_OBJECT
+public:
+    BenchHotPaths();
+
+private:
+    TalkerAccount *m_acct;
+    QScriptEngine m_engine;
+
+    QByteArray user_json(const int id) const;
+    QByteArray message_line(const int event_id, const int sender) const;
+    QByteArray users_line(const int total) const;
+
+    private slots:
+        void initTestCase();
+        void cleanupTestCase();
+
+        void parse_stream_data();
+        void parse_stream();
+        void append_messages_data();
+        void append_messages();
+        void handle_users();
+        void rebuild_user_list();
+        void decode_entities();
+};
+
+BenchHotPaths::BenchHotPaths()
+    : m_acct(0)
+{}
+
+QByteArray BenchHotPaths::user_json(const int id) const {
+    return QString("{\"id\":%1,\"name\":\"user%1\","
+                   "\"email\":\"user%1@example.com\"}").arg(id).toUtf8();
+}
+
+QByteArray BenchHotPaths::message_line(const int event_id,
+                                       const int sender) const {
+    return "{\"type\":\"message\",\"id\":\"" + QByteArray::number(event_id) +
+           "\",\"time\":1262304000,\"user\":" + user_json(sender) +
+           ",\"content\":\"benchmark message " + QByteArray::number(event_id) +
+           " with &lt;some&gt; &quot;entities&quot;<br/>and a break\"}\r\n";
+}
+
+QByteArray BenchHotPaths::users_line(const int total) const {
+    QByteArray line = "{\"type\":\"users\",\"users\":[";
+    for (int i = 0; i < total; ++i) {
+        if (i) {
+            line += ",";
+        }
+        line += user_json(i);
+    }
+    return line + "]}\r\n";
+}
+
+void BenchHotPaths::initTestCase() {
+    m_acct = new TalkerAccount("bench", "token", "bench", this);
+    m_acct->set_fetch_avatars(false); // measure parsing, not HTTP requests
+}
+
+void BenchHotPaths::cleanupTestCase() {
+    delete m_acct;
+    m_acct = 0;
+}
+
+void BenchHotPaths::parse_stream_data() {
+    QTest::addColumn<int>("events");
+    QTest::addColumn<int>("chunk"); // bytes per simulated socket read
+    QTest::newRow("1k events, 1 read") << 1000 << 0;
+    QTest::newRow("1k events, 1400 byte reads") << 1000 << 1400;
+    QTest::newRow("10k events, 1400 byte reads") << 10000 << 1400;
+}
+
+void BenchHotPaths::parse_stream() {
+    QFETCH(int, events);
+    QFETCH(int, chunk);
+
+    // idle events go through the same parsing without touching the model
+    QByteArray stream = users_line(SENDERS);
+    for (int i = 0; i < events; ++i) {
+        stream += "{\"type\":\"idle\",\"id\":\"" + QByteArray::number(i) +
+                  "\",\"time\":1262304000,\"user\":" +
+                  user_json(i % SENDERS) + "}\r\n";
+    }
+    if (chunk <= 0) {
+        chunk = stream.size();
+    }
+
+    QBENCHMARK {
+        TalkerRoom room(m_acct, "bench", 1);
+        for (int pos = 0; pos < stream.size(); pos += chunk) {
+            room.ingest(stream.mid(pos, chunk));
+        }
+    }
+}
+
+void BenchHotPaths::append_messages_data() {
+    QTest::addColumn<int>("messages");
+    QTest::addColumn<bool>("same_sender"); // exercises the append-to-row path
+    QTest::newRow("10k messages") << 10000 << false;
+    QTest::newRow("10k messages, one sender") << 10000 << true;
+    QTest::newRow("100k messages") << 100000 << false;
+}
+
+void BenchHotPaths::append_messages() {
+    QFETCH(int, messages);
+    QFETCH(bool, same_sender);
+
+    QList<QScriptValue> values;
+    for (int i = 0; i < messages; ++i) {
+        QByteArray line = message_line(i, same_sender ? 0 : i % SENDERS);
+        values << m_engine.evaluate(QString("(%1)").arg(
+                QString::fromUtf8(line.trimmed())));
+    }
+    QScriptValue users = m_engine.evaluate(QString("(%1)").arg(
+            QString::fromUtf8(users_line(SENDERS).trimmed())));
+
+    QBENCHMARK_ONCE {
+        TalkerRoom room(m_acct, "bench", 1);
+        RoomView view(&room);
+        room.handle_users(users);
+        foreach(QScriptValue val, values) {
+            room.handle_message(val);
+        }
+    }
+}
+
+void BenchHotPaths::handle_users() {
+    QScriptValue users = m_engine.evaluate(QString("(%1)").arg(
+            QString::fromUtf8(users_line(5000).trimmed())));
+    TalkerRoom room(m_acct, "bench", 1);
+    QBENCHMARK {
+        room.handle_users(users);
+    }
+}
+
+void BenchHotPaths::rebuild_user_list() {
+    QMap<int, TalkerUser*> users;
+    for (int i = 0; i < 5000; ++i) {
+        users.insert(i, new TalkerUser(QString("user%1").arg(i),
+                                       QString("user%1@example.com").arg(i),
+                                       i, this));
+    }
+    QTableWidget table(0, 1);
+    table.setSortingEnabled(true);
+    QBENCHMARK {
+        MainWindow::fill_user_list(&table, users);
+    }
+    qDeleteAll(users);
+}
+
+void BenchHotPaths::decode_entities() {
+    QString content("a &lt;b&gt; &quot;quoted&quot; line<br/>and another "
+                    "line with &LT;upper case&GT; entities<br/>");
+    QBENCHMARK {
+        TalkerRoom::decode_entities(content);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    QApplication app(argc, argv);
+    QCoreApplication::setOrganizationName("UDPSoftware");
+    QCoreApplication::setApplicationName("SmoothTalkerBench");
+
+    // write machine readable results unless told otherwise, so releases can
+    // be compared with each other
+    QStringList args = app.arguments();
+    if (!args.contains("-o") && !args.contains("-xml") &&
+        !args.contains("-xunitxml") && !args.contains("-lightxml")) {
+        args << "-xml" << "-o" << "bench_results.xml";
+    }
+    BenchHotPaths bench;
+    return QTest::qExec(&bench, args);
+}
+
+#include "bench_hot_paths.moc"
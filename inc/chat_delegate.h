@@ -0,0 +1,79 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef CHAT_DELEGATE_H
+#define CHAT_DELEGATE_H
+
+#include <QtGui>
+
+class MessageItem;
+
+/**
+  * Draws the content column of the chat. Coalesced messages are drawn one
+  * segment after another, each wrapped on its own, straight from the
+  * MessageItem; other cells are drawn as usual.
+  *
+  * Each row's text layouts are cached for the width they were made for.
+  * Segments are only ever appended, so a row that grew only lays out its
+  * new segments, and only the segments inside the viewport are drawn.
+  */
+class ChatDelegate : public QStyledItemDelegate {
+    Q_OBJECT
+public:
+    ChatDelegate(QObject *parent = 0);
+    ~ChatDelegate();
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option,
+               const QModelIndex &index) const;
+    QSize sizeHint(const QStyleOptionViewItem &option,
+                   const QModelIndex &index) const;
+
+    // the MessageItem behind index, or 0 for any other cell
+    static const MessageItem *message_at(const QModelIndex &index);
+
+    void forget(const quint64 serial); // the row is gone
+    void clear_cache(); // every row is gone, e.g. the view hibernated
+
+private:
+    // the wrapped segments of one MessageItem at one width
+    struct RowLayout {
+        ~RowLayout() {qDeleteAll(layouts);}
+        int width;
+        QFont font;
+        QVector<QTextLayout*> layouts; // one per segment laid out so far
+        QVector<int> tops; // of each segment, relative to the row
+        int height; // of all segments
+        int lines; // of all segments, the cost in the cache
+    };
+    // by MessageItem::serial(), the cost is the number of lines
+    mutable QCache<quint64, RowLayout> m_layouts;
+    // the last row too big for the cache, e.g. a very long log dump
+    mutable RowLayout *m_big;
+    mutable quint64 m_big_serial;
+
+    // the cached layout for item, updated for new segments or a new width
+    RowLayout *layout_for(const MessageItem *item, const QFont &font,
+                          const int width) const;
+    static QRect text_rect(const QStyleOptionViewItem &option);
+};
+
+#endif // CHAT_DELEGATE_H
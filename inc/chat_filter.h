@@ -0,0 +1,104 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef CHAT_FILTER_H
+#define CHAT_FILTER_H
+
+#include <QtGui>
+
+class MessageItem;
+
+/**
+  * Shows only the chat rows from one sender and/or containing every word
+  * of a search, each word matching the start of a word in the row.
+  *
+  * Rows are found through an index of senders and case folded words kept
+  * next to the model, not by testing every row's text. A query that only
+  * narrows the last one, e.g. one more letter typed, is answered from the
+  * previous matches, re-testing just those rows when there are fewer of
+  * them than rows the index would give. The index is only kept while the
+  * filter is in use.
+  * Removed rows are left in it until they outnumber the live ones and the
+  * index is rebuilt.
+  */
+class ChatFilter : public QSortFilterProxyModel {
+    Q_OBJECT
+public:
+    ChatFilter(QStandardItemModel *source, QObject *parent = 0);
+
+    void start(); // index the rows, the filter is off until set_query()
+    void stop(); // drop the query and the index, detach from the model
+    // -1 for any sender; an empty query turns the filter off
+    void set_query(const int user_id, const QString &text);
+    bool is_active() const {return m_user_id != -1 || !m_terms.isEmpty();}
+
+    QMap<QString, int> senders() const; // ids by name, of indexed rows
+
+protected:
+    bool filterAcceptsRow(int source_row,
+                          const QModelIndex &source_parent) const;
+
+private:
+    typedef QVector<quint64> Postings; // MessageItem serials
+    struct IndexedRow {
+        MessageItem *item;
+        int user_id;
+    };
+
+    QStandardItemModel *m_source;
+    bool m_indexed;
+    QHash<int, Postings> m_by_sender;
+    QHash<int, QString> m_sender_names;
+    QMap<QString, Postings> m_by_word; // sorted, for prefix lookups
+    QHash<quint64, IndexedRow> m_rows; // live rows by serial
+    int m_live_rows; // indexed rows still in the model
+    int m_stale_rows; // indexed rows since removed
+
+    int m_user_id;
+    QStringList m_terms; // case folded
+    QSet<quint64> m_matches; // serials of the rows shown
+
+    void build_index();
+    void index_segment(const quint64 serial, const QString &text);
+    void index_row(const int row); // message rows, others are skipped
+    MessageItem *message(const int row) const;
+    bool matches(const int row) const; // tests the row's own text
+    // keep only the matches with a word starting with term
+    void narrow_matches(const QString &term);
+    void refresh_matches(); // work out m_matches from the index alone
+    // serials of rows with a word starting with term
+    QSet<quint64> lookup(const QString &term) const;
+    // rows lookup() would go through, counting stops once past limit
+    int postings(const QString &term, const int limit) const;
+    static bool has_prefix(const MessageItem *item, const QString &term);
+    static QStringList words(const QString &text); // case folded
+
+    private slots:
+        void on_rows_inserted(const QModelIndex &parent, int first, int last);
+        void on_rows_removing(const QModelIndex &parent, int first, int last);
+        void on_rows_removed();
+        void on_data_changed(const QModelIndex &top_left,
+                             const QModelIndex &bottom_right);
+        void on_model_reset();
+};
+
+#endif // CHAT_FILTER_H
@@ -0,0 +1,59 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef DIAGNOSTICS_DIALOG_H
+#define DIAGNOSTICS_DIALOG_H
+
+#include <QtGui>
+
+class TalkerAccount;
+
+/**
+  * Shows live diagnostics of every open room, like how long messages take
+  * from the socket to the screen and how much memory each one holds.
+  */
+class DiagnosticsDialog : public QDialog {
+    Q_OBJECT
+public:
+    DiagnosticsDialog(const QList<TalkerAccount*> *accounts,
+                      QWidget *parent = 0);
+
+protected:
+    void showEvent(QShowEvent *e);
+    void hideEvent(QHideEvent *e);
+
+private:
+    QTabWidget *m_tabs;
+    QTableWidget *m_latency; // percentiles per room and stage
+    QTreeWidget *m_memory; // usage per account and room
+    QLabel *m_process_memory; // resident size of the whole process
+    const QList<TalkerAccount*> *m_accounts; // owned by the main window
+    QTimer *m_timer; // refreshes while the dialog is visible
+
+    private slots:
+        void refresh();
+        void refresh_memory();
+        void export_trace();
+        void trim_caches();
+};
+
+#endif // DIAGNOSTICS_DIALOG_H
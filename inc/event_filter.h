@@ -0,0 +1,56 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef EVENT_FILTER_H
+#define EVENT_FILTER_H
+
+#include <QtCore>
+
+/**
+  * Remembers which event ids a room has already seen so events the server
+  * replays after a reconnect can be dropped. The newest ids are kept exactly
+  * in a small ring, older ones fall into a pair of rotating bloom filters
+  * that are saved with the room. Checking an id is O(1) and memory is fixed
+  * no matter how much history the room has.
+  */
+class EventFilter {
+public:
+    EventFilter();
+
+    // true if the id was seen before, otherwise remembers it
+    bool seen(const QString &event_id);
+
+    bool load(const QString &path);
+    bool save(const QString &path);
+
+private:
+    QSet<QString> m_recent; // exact set of the newest ids
+    QQueue<QString> m_recent_order; // oldest first, bounds m_recent
+    QBitArray m_bloom[2]; // current and previous generation
+    int m_bloom_count[2]; // ids added to each generation
+    int m_current; // which generation new ids go into
+
+    bool bloom_contains(const QString &event_id) const;
+    void bloom_insert(const QString &event_id);
+};
+
+#endif // EVENT_FILTER_H
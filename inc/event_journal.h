@@ -0,0 +1,70 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef EVENT_JOURNAL_H
+#define EVENT_JOURNAL_H
+
+#include <QtCore>
+
+/**
+  * Tiny write-ahead journal of the newest event id seen in each room. Ids are
+  * appended as "<room id> <event id>" lines and committed in groups at most
+  * every few hundred milliseconds, so after a crash the next connect only
+  * replays the last moments instead of everything since a clean shutdown.
+  * The writes and syncs run on a worker thread; the GUI thread only collects
+  * the ids.
+  */
+class EventJournal : public QObject {
+    Q_OBJECT
+public:
+    EventJournal(const QString &path, QObject *parent = 0);
+    ~EventJournal();
+
+    // the journal created by the main window
+    static EventJournal *instance() {return s_instance;}
+
+    // newest id recovered or recorded for a room, empty if we have none
+    QString last_event_id(const int room_id) const;
+    void record(const int room_id, const QString &event_id);
+    // write everything still pending and wait until it is on disk
+    void flush();
+
+    public slots:
+        void commit(); // write all pending ids as one group
+        void compact(); // rewrite the file with one line per room
+
+private:
+    static EventJournal *s_instance;
+    QString m_path; // the journal file
+    QHash<int, QString> m_latest; // newest id per room
+    QHash<int, QString> m_pending; // ids not yet committed
+    QTimer *m_timer; // group commit timer
+    int m_lines; // lines in the file, used to decide when to compact
+    bool m_compact_due; // rewrite the file once the running write is done
+    QFuture<void> m_write; // the write currently running, if any
+
+    QByteArray group(const QHash<int, QString> &ids) const;
+
+    void recover(); // read back the newest id per room from disk
+};
+
+#endif // EVENT_JOURNAL_H
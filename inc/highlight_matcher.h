@@ -0,0 +1,62 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef HIGHLIGHT_MATCHER_H
+#define HIGHLIGHT_MATCHER_H
+
+#include <QtCore>
+
+/**
+  * Finds any of a list of words in a message in a single pass, however many
+  * words there are. The words are compiled into an Aho-Corasick automaton
+  * over case folded text. A word that starts (ends) with a letter or digit
+  * only matches at the start (end) of a word, so "al" doesn't match "also"
+  * but the ticket prefix "INC-" matches "INC-1234".
+  */
+class HighlightMatcher {
+public:
+    HighlightMatcher(const QStringList &patterns = QStringList());
+
+    bool isEmpty() const {return m_patterns.isEmpty();}
+    QStringList patterns() const {return m_patterns;}
+
+    // the patterns found in text, each listed once
+    QStringList match(const QString &text) const;
+
+private:
+    QStringList m_patterns; // as configured, for reporting matches
+    QVector<int> m_lengths; // of each pattern
+    QVector<bool> m_word_start; // pattern must start at a word boundary
+    QVector<bool> m_word_end; // pattern must end at a word boundary
+
+    // states of the automaton, 0 is the root
+    QHash<quint64, int> m_next; // (state << 16 | folded char) to state
+    QVector<int> m_fail; // longest proper suffix that is also a state
+    QVector<int> m_out; // pattern ending at this state, or -1
+    QVector<int> m_dict; // nearest state on the fail chain with a pattern
+
+    int step(const int state, const ushort c) const {
+        return m_next.value((quint64(state) << 16) | c, -1);
+    }
+};
+
+#endif // HIGHLIGHT_MATCHER_H
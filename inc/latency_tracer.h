@@ -0,0 +1,99 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef LATENCY_TRACER_H
+#define LATENCY_TRACER_H
+
+#include <QtCore>
+
+/**
+  * Timestamps of one message on its way from the socket to the screen, in
+  * microseconds since the tracer clock started.
+  */
+struct MessageTrace {
+    MessageTrace() : read(0), parsed(0), inserted(0), laid_out(0),
+                     painted(0) {}
+    QString event_id;
+    qint64 read; // TLS readyRead handed us the bytes
+    qint64 parsed; // the JSON was evaluated
+    qint64 inserted; // the row is in the model
+    qint64 laid_out; // columns and rows were resized
+    qint64 painted; // the view painted for the first time afterwards
+};
+
+/**
+  * Per-room latency histograms for each stage of a message plus a ring of
+  * the most recent traces. Recording a trace is a few array increments, so
+  * the tracer is always on.
+  */
+class RoomLatency {
+public:
+    enum Stage {
+        Parse = 0, // read -> parsed
+        Insert, // parsed -> inserted
+        Layout, // inserted -> laid out
+        Paint, // laid out -> painted
+        Total, // read -> painted
+        StageCount
+    };
+    static const int BUCKETS = 32; // bucket n holds latencies < 2^n usec
+
+    RoomLatency(const QString &room_name, const int room_id);
+
+    QString room_name() const {return m_room_name;}
+    int room_id() const {return m_room_id;}
+    void add(const MessageTrace &trace);
+
+    qint64 count(const Stage stage) const {return m_counts[stage];}
+    // upper bound of the bucket holding the given percentile, in usec
+    qint64 percentile(const Stage stage, const double pct) const;
+    QList<MessageTrace> recent() const {return m_recent;}
+
+    static QString stage_name(const Stage stage);
+
+private:
+    QString m_room_name;
+    int m_room_id;
+    qint64 m_buckets[StageCount][BUCKETS];
+    qint64 m_counts[StageCount];
+    QList<MessageTrace> m_recent; // newest last, bounded
+};
+
+/**
+  * Registry of every room's latency data, used by the diagnostics dialog.
+  */
+class LatencyTracer {
+public:
+    static qint64 now_usec(); // the clock all traces are stamped with
+
+    static void add_room(RoomLatency *room);
+    static void remove_room(RoomLatency *room);
+    static QList<RoomLatency*> rooms() {return s_rooms;}
+
+    // write the recent traces of every room as Chrome trace-event JSON
+    static bool export_chrome_trace(const QString &path);
+
+private:
+    static QList<RoomLatency*> s_rooms;
+};
+
+#endif // LATENCY_TRACER_H
@@ -27,6 +27,8 @@ THE SOFTWARE.
 #include <QtNetwork>
 #include <QScriptEngine>
 
+#include "room_registry.h"
+
 namespace Ui {
     class MainWindow;
 }
@@ -36,6 +38,12 @@ class TalkerRoom;
 class TalkerUser;
 class CustomTabWidget;
 class OptionsDialog;
+class DiagnosticsDialog;
+class SettingsStore;
+class EventJournal;
+class MetricsServer;
+class Notifier;
+class TranscriptExport;
 
 /**
   * The core of the whole app. Handles choosing accounts, and showing of the
@@ -50,29 +58,77 @@ public:
     void save_settings();
     void load_settings();
 
+    // rebuild a user list table from a room's users
+    static void fill_user_list(QTableWidget *table,
+                               const QMap<int, TalkerUser*> &users);
+
     public slots:
         void save_accounts();
         int load_accounts();
 
 protected:
     void changeEvent(QEvent *e);
+    void showEvent(QShowEvent *e);
+    void hideEvent(QHideEvent *e);
     void closeEvent(QCloseEvent *e);
 
 private:
     Ui::MainWindow *ui;
-    QSettings *m_settings; // manages app settings
+    SettingsStore *m_store; // options snapshot and batched settings writes
+    QSettings *m_settings; // manages app settings, owned by m_store
+    EventJournal *m_journal; // crash-safe record of each room's last event
     QMenu *m_tray_menu; // the context menu for right clicks on our tray icon
     QSystemTrayIcon *m_tray; // holds our handly little tray icon
     OptionsDialog *m_options; // options dialog menu
+    DiagnosticsDialog *m_diagnostics; // live latency and memory numbers
+    QNetworkAccessManager *m_net; // connection pool shared by all accounts
+    MetricsServer *m_metrics; // only set when the metrics endpoint is on
+    Notifier *m_notifier; // sounds and tray popups for new messages
+    TranscriptExport *m_export; // the running export, one at a time
+    QProgressDialog *m_export_progress;
 
     QList<TalkerAccount*> m_accounts; // list of configured accounts
+    QHash<QString, TalkerAccount*> m_account_names; // m_accounts by name
     int m_connected_accounts; // holds how many accounts are logged in
+    bool m_background; // minimized or hidden, views skip all layout
     CustomTabWidget *m_tabs;
     QTabBar *m_tab_bar;
 
+    RoomRegistry m_rooms; // every connected room and its tab
+    RoomEntry *m_front; // the room whose tab is shown, or 0
+    int m_total_unread; // sum over every room, for the tray tooltip
+    int m_total_mentions;
+    QSet<RoomEntry*> m_stale_labels; // rooms whose tab label needs new counts
+    QTimer *m_label_timer; // limits how often the tab labels are redrawn
+
+    // item data role holding the owning account name in the room list
+    static const int AccountRole = Qt::UserRole + 1;
+
+    // serve metrics if the options ask for it
+    void start_metrics();
+    // put every room view into or out of background mode as the window
+    // is minimized, hidden or restored
+    void update_background_mode();
+    // reset a room's counts once it's being looked at
+    void mark_read(RoomEntry *entry);
+    // take ownership of an account and hook up its signals
+    void add_account(TalkerAccount *acct);
+    void index_accounts(); // rebuild m_account_names after names change
     // single method to enable/disable GUI elements
     void set_interface_enabled(const bool &enabled);
-    void add_user_to_room_list(const TalkerUser *user);
+    static void add_user_to_room_list(QTableWidget *table,
+                                      const TalkerUser *user);
+
+    /**
+      * Shows a configuration dialog for a user-account token as well as the
+      * talkerapp.com subdomain the user wants to connect to. After the dialog
+      * is accepted the new account object is created on the heap and passed
+      * back to the caller.
+      */
+    static TalkerAccount *create_account(QObject *account_owner,
+                                         QWidget *dialog_parent = 0);
+    // edit an account in the same dialog, false if it was cancelled
+    static bool edit_account(TalkerAccount *acct, QWidget *dialog_parent = 0);
 
     private slots:
         void login();
@@ -84,18 +140,24 @@ private:
         void on_room_disconnected(const int room_id);
         void on_tab_switch(int new_idx);
         void on_tab_close(int tab_idx);
+        void on_tab_moved(int from, int to);
         void on_message_received(const QString &sender, const QString &content,
+                                 const QStringList &highlights,
                                  const TalkerRoom *room);
         void on_users_updated(const TalkerRoom*);
         void on_user_updated(const TalkerRoom*, const TalkerUser*);
         void on_options_activated(); // user clicked options menu item
         void on_about_activated(); // user clicked about menu item
+        void on_diagnostics_activated(); // user clicked diagnostics item
+        void on_filter_activated(); // filter the shown room's table
+        void on_export_activated(); // export the shown room's transcript
+        void on_export_finished(bool ok, const QString &error);
+        void on_choose_rooms(const TalkerAccount &acct);
+        void on_login_failed(const TalkerAccount &acct);
+        void on_error(const QString &title, const QString &message);
 
         void status_message(const QString &msg);
-
-signals:
-        void options_changed(QSettings*);
-
+        void update_unread_labels(); // redraw the labels of stale tabs
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,64 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef MEMORY_USAGE_H
+#define MEMORY_USAGE_H
+
+#include <QtGlobal>
+
+/**
+  * Estimated memory held by an account or a room, broken down by what holds
+  * it. Counters are kept as rows are added, the rest is summed on request,
+  * so this is cheap enough to leave on in release builds.
+  */
+struct MemoryUsage {
+    MemoryUsage()
+        : model_rows(0), model_bytes(0), users(0), user_bytes(0), avatars(0),
+          avatar_bytes(0), net_managers(0), script_engines(0) {}
+
+    int model_rows; // rows in chat models
+    qint64 model_bytes; // items and text of those rows
+    int users; // user records
+    qint64 user_bytes; // the records and their strings
+    int avatars; // loaded avatars
+    qint64 avatar_bytes; // encoded images, decoded ones live in QPixmapCache
+    int net_managers; // QNetworkAccessManagers owned
+    int script_engines; // QScriptEngines owned
+
+    qint64 total_bytes() const {
+        return model_bytes + user_bytes + avatar_bytes;
+    }
+
+    MemoryUsage &operator+=(const MemoryUsage &o) {
+        model_rows += o.model_rows;
+        model_bytes += o.model_bytes;
+        users += o.users;
+        user_bytes += o.user_bytes;
+        avatars += o.avatars;
+        avatar_bytes += o.avatar_bytes;
+        net_managers += o.net_managers;
+        script_engines += o.script_engines;
+        return *this;
+    }
+};
+
+#endif // MEMORY_USAGE_H
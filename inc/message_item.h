@@ -0,0 +1,105 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef MESSAGE_ITEM_H
+#define MESSAGE_ITEM_H
+
+#include <QtGui>
+
+#include "text_arena.h"
+
+// one message coalesced into a chat row, the strings are in a TextArena
+struct MessageSegment {
+    TextRef text;
+    TextRef event_id;
+    uint time; // seconds since the epoch
+};
+Q_DECLARE_TYPEINFO(MessageSegment, Q_PRIMITIVE_TYPE);
+
+/**
+  * Content cell of a chat row: the messages one sender posted in a row,
+  * kept as separate segments so adding one never copies the text of the
+  * others. The text lives as UTF-8 in the room's TextArena and is decoded
+  * through a small cache of the rows asked for last, which are mostly the
+  * ones on screen. ChatDelegate draws the segments; the joined text is
+  * only built when something asks the item for its text.
+  */
+class MessageItem : public QStandardItem {
+public:
+    enum {Type = QStandardItem::UserType + 1};
+
+    MessageItem(TextArena *arena, const QDateTime &time, const QString &text,
+                const QString &event_id);
+    ~MessageItem();
+
+    int type() const {return Type;}
+    QVariant data(int role = Qt::UserRole + 1) const;
+    QStandardItem *clone() const;
+
+    // also repaints the row
+    void append(const QDateTime &time, const QString &text,
+                const QString &event_id);
+    int segment_count() const {return m_segments.size();}
+    QString text(const int segment) const;
+    QString event_id(const int segment) const;
+    QDateTime time(const int segment) const;
+    int text_size() const {return m_text_size;} // characters, no joins
+    int arena_bytes() const {return m_arena_bytes;} // what we put in it
+    // copy our strings into arena and use it from now on
+    void move_to(TextArena *arena);
+    // unique for the life of the app, unlike the item's address
+    quint64 serial() const {return m_serial;}
+
+private:
+    quint64 m_serial;
+    TextArena *m_arena; // the room's, outlives its items
+    QVector<MessageSegment> m_segments; // only ever appended to
+    int m_text_size; // over all segments
+    int m_arena_bytes;
+
+    QStringList texts() const; // every segment decoded, through the cache
+};
+
+/**
+  * Time cell of a chat row. Keeps the time as seconds and formats it only
+  * when the cell is drawn, along with where the row starts in the room's
+  * history.
+  */
+class TimeItem : public QStandardItem {
+public:
+    enum {Type = QStandardItem::UserType + 2};
+
+    TimeItem(const QDateTime &time, const qint64 offset);
+
+    int type() const {return Type;}
+    QVariant data(int role = Qt::UserRole + 1) const;
+    QStandardItem *clone() const {return new TimeItem(*this);}
+
+    QDateTime time() const {return QDateTime::fromTime_t(m_time);}
+    qint64 offset() const {return m_offset;} // in the history, or -1
+
+private:
+    uint m_time;
+    qint64 m_offset;
+};
+
+#endif // MESSAGE_ITEM_H
@@ -0,0 +1,145 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QtCore>
+#include <QtNetwork>
+
+/**
+  * 64 bit counter without a lock for one writing thread and any number of
+  * readers. The writer bumps a sequence number around storing the two
+  * halves, a reader that sees it odd or changed reads again.
+  */
+class Counter64 {
+public:
+    Counter64() : m_seq(0), m_low(0), m_high(0) {}
+
+    void add(const int n) { // only ever called from the same thread
+        qint64 v = halves() + n;
+        m_seq.fetchAndAddOrdered(1); // odd while the halves change
+        m_low.fetchAndStoreRelaxed(int(quint32(v)));
+        m_high.fetchAndStoreRelaxed(int(v >> 32));
+        m_seq.fetchAndAddOrdered(1);
+    }
+    qint64 value() const { // safe to call from any thread
+        forever {
+            int before = m_seq.fetchAndAddOrdered(0);
+            qint64 v = halves();
+            if (!(before & 1) && m_seq.fetchAndAddOrdered(0) == before) {
+                return v;
+            }
+        }
+    }
+
+private:
+    mutable QAtomicInt m_seq;
+    QAtomicInt m_low;
+    QAtomicInt m_high;
+
+    qint64 halves() const {
+        return (qint64(int(m_high)) << 32) | quint32(int(m_low));
+    }
+};
+
+/**
+  * Health counters of one room. Rooms only ever touch these atomics, so a
+  * scrape from the metrics thread never has to look at GUI thread state.
+  * Entries live for the whole process, a room that reconnects keeps adding
+  * to the same counters.
+  */
+struct RoomMetrics {
+    RoomMetrics(const int id, const QString &name)
+        : room_id(id), room_name(name) {}
+
+    const int room_id;
+    const QString room_name;
+    Counter64 events; // events handled
+    Counter64 bytes; // bytes read off the socket
+    QAtomicInt parse_errors; // lines that failed to parse
+    QAtomicInt connects; // successful connects, the first one included
+    QAtomicInt keepalive_rtt_usec; // ping until the next read, last sample
+    QAtomicInt queue_depth; // bytes read but not yet handled
+};
+
+/**
+  * Process wide registry of metrics, rendered in the Prometheus text format
+  */
+class Metrics {
+public:
+    // the counters for a room, created the first time a room asks
+    static RoomMetrics *room(const int room_id, const QString &room_name);
+
+    // called from the GUI thread when the event loop was late
+    static void add_gui_stall(const int msec);
+
+    static QByteArray render(); // safe to call from any thread
+
+private:
+    static QMutex s_lock; // guards s_rooms, never taken on the hot path
+    static QList<RoomMetrics*> s_rooms;
+    static QAtomicInt s_gui_stall_msec; // total time the GUI was late
+    static QAtomicInt s_gui_stall_max_msec; // longest stall since a scrape
+};
+
+/**
+  * Measures how late a timer in the GUI thread fires, which is how long the
+  * event loop was stuck doing something else.
+  */
+class StallMonitor : public QObject {
+    Q_OBJECT
+public:
+    StallMonitor(QObject *parent = 0);
+
+private:
+    QTimer *m_timer;
+    QElapsedTimer m_clock; // time since the last tick
+
+    private slots:
+        void tick();
+};
+
+/**
+  * Serves Metrics::render() over HTTP on a loopback port. Lives on its own
+  * thread so scraping works even while the GUI is busy.
+  */
+class MetricsServer : public QObject {
+    Q_OBJECT
+public:
+    MetricsServer(const quint16 port);
+    ~MetricsServer();
+
+    void start(); // moves the server to its thread and starts listening
+
+private:
+    quint16 m_port;
+    QThread m_thread;
+    QTcpServer *m_server; // created on m_thread
+
+    private slots:
+        void listen();
+        void on_connection();
+        void on_ready_read();
+};
+
+#endif // METRICS_H
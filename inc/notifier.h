@@ -0,0 +1,78 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef NOTIFIER_H
+#define NOTIFIER_H
+
+#include <QtGui>
+
+#include "settings_store.h"
+
+// forward declarations
+class TalkerRoom;
+
+/**
+  * Sounds and tray popups for new messages. The sound is loaded once per
+  * options snapshot instead of being looked up for every message, and
+  * messages are gathered per room for a short window so a burst turns into
+  * one sound and one popup like "12 new messages in Ops". Messages the
+  * server replays while a room catches up after connecting are not
+  * notified at all.
+  */
+class Notifier : public QObject {
+    Q_OBJECT
+public:
+    Notifier(QSystemTrayIcon *tray, QWidget *window);
+
+    void notify(const TalkerRoom *room, const QString &sender,
+                const QString &content, const QStringList &highlights);
+
+    public slots:
+        void on_options_changed(OptionsPtr opts);
+
+private:
+    // what came in for one room since the last flush
+    struct Pending {
+        Pending() : messages(0), popup(false) {}
+        QString room_name;
+        int messages;
+        bool popup; // at least one message should pop up
+        QString last_sender;
+        QString last_content;
+        QString mention_sender; // last sender of a highlighted message
+        QStringList highlights; // every highlight word seen
+    };
+
+    QSystemTrayIcon *m_tray;
+    QWidget *m_window; // checked for being minimized or inactive
+    OptionsPtr m_opts;
+    QSound *m_sound; // 0 when no sound is configured or the file is missing
+    QString m_sound_path; // what m_sound was loaded from
+    QTimer *m_timer; // the coalescing window
+    QList<Pending> m_pending; // in the order the rooms first spoke
+    QHash<const TalkerRoom*, int> m_pending_index; // room to m_pending
+
+    private slots:
+        void flush(); // the window closed, notify what gathered
+};
+
+#endif // NOTIFIER_H
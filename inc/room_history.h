@@ -0,0 +1,89 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef ROOM_HISTORY_H
+#define ROOM_HISTORY_H
+
+#include <QtCore>
+
+// one chat row, or one segment of a coalesced row, as kept on disk
+struct HistoryRecord {
+    enum Kind {Message = 0, System = 1};
+
+    HistoryRecord() : offset(-1), next(-1), kind(Message), user_id(0),
+                      highlighted(false) {}
+    qint64 offset; // where the record starts in the file
+    qint64 next; // where the record after it starts, set when read
+    int kind;
+    QDateTime time;
+    int user_id;
+    QString user_name;
+    QString content; // the message, or the text of a system row
+    QString event_id;
+    bool highlighted;
+};
+
+/**
+  * Append-only file of everything a room showed, for scrolling back past
+  * what the view keeps in memory. Each record is framed by its length on
+  * both sides so pages can be read forwards from any record or backwards
+  * from the end of one:
+  *
+  *   [quint32 length][record][quint32 length]
+  *
+  * Writes are buffered and flushed by the owner. Pages are read with
+  * static functions that open the file on their own, so they can run on a
+  * worker thread while the GUI thread keeps appending.
+  */
+class RoomHistory {
+public:
+    RoomHistory(const QString &path);
+    ~RoomHistory();
+
+    bool is_open() const {return m_file.isOpen();}
+    QString path() const {return m_file.fileName();}
+    qint64 size() const {return m_size;} // including unflushed writes
+
+    qint64 append(const HistoryRecord &record); // returns the record offset
+    void flush();
+
+    // up to count records that end at or before offset, oldest first
+    static QList<HistoryRecord> read_before(const QString &path,
+                                            const qint64 offset,
+                                            const int count);
+    // up to count records from offset on that end at or before end
+    static QList<HistoryRecord> read_after(const QString &path,
+                                           const qint64 offset,
+                                           const int count, const qint64 end);
+
+private:
+    QFile m_file;
+    qint64 m_size; // kept here, QFile::size() would flush the buffer
+
+    bool tail_is_valid(); // false if the last write was cut off
+    qint64 last_valid_end(); // end of the last whole record from the start
+    static bool read_record(QFile *file, const qint64 offset,
+                            HistoryRecord *record, qint64 *next);
+    Q_DISABLE_COPY(RoomHistory)
+};
+
+#endif // ROOM_HISTORY_H
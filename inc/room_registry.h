@@ -0,0 +1,86 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef ROOM_REGISTRY_H
+#define ROOM_REGISTRY_H
+
+#include <QtCore>
+
+// forward declarations
+class TalkerAccount;
+class TalkerRoom;
+class RoomView;
+
+// messages that came in while a room wasn't being looked at
+struct UnreadCount {
+    UnreadCount() : unread(0), mentions(0) {}
+    int unread;
+    int mentions; // unread messages with a highlight word
+};
+
+// everything the main window knows about one connected room
+struct RoomEntry {
+    TalkerAccount *account;
+    TalkerRoom *room;
+    RoomView *view; // owned by the room
+    int tab; // index in the tab bar, -1 until the tab is added
+    UnreadCount counts;
+};
+
+/**
+  * Every connected room of every account, keyed by (account, room id) and
+  * by tab index so the main window never has to walk accounts, rooms or
+  * tabs to find the room an action is about. Tab indexes are kept in step
+  * with the tab bar: tell the registry about every tab that is added,
+  * removed or moved.
+  */
+class RoomRegistry {
+public:
+    RoomRegistry() {}
+    ~RoomRegistry();
+
+    RoomEntry *add(TalkerRoom *room, RoomView *view);
+    void remove(const TalkerAccount *acct, const int room_id);
+
+    RoomEntry *find(const TalkerAccount *acct, const int room_id) const {
+        return m_rooms.value(qMakePair(acct, room_id));
+    }
+    RoomEntry *find(const TalkerRoom *room) const;
+    RoomEntry *at_tab(const int tab) const {
+        return tab >= 0 && tab < m_tabs.size() ? m_tabs.at(tab) : 0;
+    }
+    QList<RoomEntry*> entries() const {return m_rooms.values();}
+
+    void tab_inserted(RoomEntry *entry, const int tab);
+    void tab_removed(const int tab);
+    void tab_moved(const int from, const int to);
+
+private:
+    typedef QPair<const TalkerAccount*, int> Key;
+    QHash<Key, RoomEntry*> m_rooms;
+    QVector<RoomEntry*> m_tabs; // in tab bar order
+
+    void renumber(const int from, const int to); // set tab of a range
+    Q_DISABLE_COPY(RoomRegistry)
+};
+
+#endif // ROOM_REGISTRY_H
@@ -0,0 +1,178 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef ROOM_VIEW_H
+#define ROOM_VIEW_H
+
+#include <QtGui>
+
+#include "talker_room.h"
+#include "latency_tracer.h"
+#include "memory_usage.h"
+#include "room_history.h"
+#include "transcript_export.h"
+#include "text_arena.h"
+
+class ChatDelegate;
+class ChatFilter;
+
+/**
+  * The chat table of a room. Lives as a child of its TalkerRoom and turns
+  * the room's messages into rows, everything else about the room stays in
+  * the core.
+  *
+  * Views of background tabs hibernate: their rows are kept as compressed
+  * records instead of items, and nothing is laid out until the tab is shown
+  * and the rows are expanded again. While the window is minimized every
+  * view is in background mode: rows still go into the model but the table
+  * is detached from it and laid out once when the window comes back.
+  *
+  * Row heights are only worked out right away for the rows on screen, the
+  * rest are sized a chunk at a time from the event loop, e.g. after the
+  * window is resized.
+  *
+  * Every row is also written to the room's history file. Scrolling near
+  * the top loads older pages from it on a worker thread, and rows far
+  * below the viewport are dropped to keep the table bounded; they come
+  * back a page at a time when scrolling down again. While the bottom of
+  * the table isn't the newest message, new messages only go to the file.
+  *
+  * A filter bar above the table narrows it to one sender or a search
+  * through a ChatFilter. It covers the rows in the table; history isn't
+  * paged in while it's open.
+  */
+class RoomView : public QObject {
+    Q_OBJECT
+public:
+    RoomView(TalkerRoom *room);
+    virtual ~RoomView();
+
+    TalkerRoom *room() const {return m_room;}
+    QWidget *get_widget() const {return m_page;} // the filter bar and table
+
+    MemoryUsage memory_usage() const; // just the rows, the room counts users
+    // drop rows past the configured message limit
+    void trim_caches();
+
+    void hibernate(); // move the rows into compact storage
+    void wake(); // turn the stored rows back into items
+    bool is_hibernated() const {return m_hibernated;}
+    void set_background(const bool background); // no view work while set
+    void show_filter(); // open the filter bar and put the cursor in it
+
+    // an export of everything the room showed, from the history file or
+    // without one from the table, ready to start
+    TranscriptExport *export_transcript(const QString &path);
+
+    // the user's avatar, decoded once and kept in QPixmapCache
+    static QIcon avatar(const TalkerUser *user);
+
+    public slots:
+        void on_options_changed(OptionsPtr opts);
+
+protected:
+    bool eventFilter(QObject *obj, QEvent *e); // notices paints of m_chat
+
+private:
+    TalkerRoom *m_room; // the room we show, also our parent
+    QWidget *m_page; // holds the filter bar and m_chat
+    QTableView *m_chat; // shows messages
+    ChatDelegate *m_delegate; // draws m_chat's message column
+    QStandardItemModel *m_model; // stores messages
+    OptionsPtr m_opts; // options snapshot shared with the other rooms
+    RoomLatency m_latency; // how long messages take to reach the screen
+    QList<MessageTrace> m_unpainted; // traces waiting for the next paint
+    qint64 m_model_bytes; // estimated size of m_model's items, not the text
+    TextArena *m_arena; // message text of the rows, as UTF-8
+    qint64 m_arena_live; // bytes of m_arena the rows still use
+    int m_last_sender_id; // sender of the last row, -1 for a system row
+
+    bool m_hibernated;
+    bool m_background; // the window is minimized or hidden
+    QList<QByteArray> m_frozen; // qCompress'd chunks of row records
+    QByteArray m_pending; // records not compressed into a chunk yet
+
+    QWidget *m_filter_bar; // hidden until show_filter()
+    QComboBox *m_filter_user;
+    QLineEdit *m_filter_text;
+    ChatFilter *m_filter; // shown instead of m_model while it filters
+
+    RoomHistory *m_history; // 0 when history is turned off
+    QTimer *m_history_timer; // flushes the history a second after a write
+    qint64 m_top_offset; // history offset of the first row
+    qint64 m_bottom_offset; // history offset just past the last row
+    bool m_live; // the last row is the newest message
+    QFutureWatcher<QList<HistoryRecord> > *m_page_watcher;
+    bool m_paging_older; // direction of the page being read
+    qint64 m_paging_end; // history size when a newer page was asked for
+    int m_generation; // bumped by clear() so stale pages are dropped
+    int m_paging_generation; // m_generation when the page was asked for
+
+    QTimer *m_relayout_timer; // sizes the rows off screen in chunks
+    int m_relayout_row; // next row to size, counting down to 0
+    int m_relayout_skip_from; // rows already sized with the viewport
+    int m_relayout_skip_to;
+
+    // rows go at the end unless a row number is given
+    void add_message_row(const QDateTime &time, const int user_id,
+                         const QString &user_name, const QString &content,
+                         const QString &event_id, const bool highlighted,
+                         const qint64 offset, const int row = -1);
+    // coalesce a message into a row, it stays a separate segment
+    void append_to_row(const QDateTime &time, const QString &content,
+                       const QString &event_id, const bool highlighted,
+                       const int row = -1);
+    void highlight_row(const int row); // a highlight word was in the row
+    void add_system_row(const QDateTime &time, const QString &message,
+                        const qint64 offset, const int row = -1);
+    // also compacts m_arena once most of it belongs to removed rows
+    void remove_rows(const int row, const int count);
+    void reset_arena(); // a fresh arena for when every row is gone
+    qint64 row_bytes(const int row) const; // estimated size of one row
+    qint64 row_offset(const int row) const; // history offset of a row
+    // write a row, or segment, to the history, returns its offset or -1
+    qint64 remember(const HistoryRecord &record);
+    void load_page(const bool older); // ask for the next page of history
+    void maybe_load_page(); // when scrolled close enough to an edge
+    void finish_traces(); // for traces waiting on a paint that won't come
+    void relayout(); // attach the table again and lay out all rows
+    // size the rows on screen now and the rest in the background
+    void start_relayout();
+    // add a record to m_pending, compressing it into a chunk when it's big
+    void freeze(const int kind, const QStringList &fields,
+                const int user_id = 0, const bool highlighted = false,
+                const qint64 offset = -1);
+
+    private slots:
+        void clear(); // empty the table, e.g. when the room connects
+        void on_message(const RoomMessage &msg);
+        void on_system_message(const QDateTime &time, const QString &message);
+        void on_section_resized(int column, int old_width, int new_width);
+        void continue_relayout(); // size the next chunk of rows
+        void on_scrolled(int value);
+        void on_page_loaded(); // put a page of history into the table
+        void flush_history();
+        void apply_filter(); // the filter bar changed
+        void hide_filter();
+};
+
+#endif // ROOM_VIEW_H
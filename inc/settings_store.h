@@ -0,0 +1,113 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef SETTINGS_STORE_H
+#define SETTINGS_STORE_H
+
+#include <QtCore>
+
+#include "highlight_matcher.h"
+
+/**
+  * Typed, read-only copy of everything under "options/", "connection/",
+  * "diagnostics/", "metrics/" and "history/" in the settings file. A new
+  * snapshot is built only when the options change, so the hot paths can
+  * read options without touching QSettings at all.
+  */
+class Options {
+public:
+    Options();
+    void load(QSettings *s);
+
+    bool show_timestamps;
+    bool flash_when_not_active;
+    bool reopen_last_session_rooms;
+    int total_messages_per_room; // 0 means unlimited
+    QString sound_message_received; // path to a .wav, may be empty
+    // words to highlight in every room, compiled once per snapshot
+    QSharedPointer<const HighlightMatcher> highlights;
+
+    // where to connect, only changed to point at a local test server
+    QString server_host;
+    quint16 server_port;
+    QString rooms_url; // %1 is replaced with the account's subdomain
+    bool ignore_ssl_errors; // accept self-signed test certificates
+
+    // tee each room's socket reads into capture files, off by default
+    bool record_traffic;
+    QString capture_dir; // empty means "captures" next to the settings
+
+    // serve Prometheus metrics on a loopback port, read once at startup
+    bool metrics_enabled;
+    quint16 metrics_port;
+
+    // keep what each room showed on disk for scrolling back
+    bool history_enabled;
+    QString history_dir; // defaults to "history" next to the settings
+};
+
+typedef QSharedPointer<const Options> OptionsPtr;
+
+/**
+  * Owns the single QSettings object of the app along with the current
+  * options snapshot. Values that change often (like each room's last event
+  * id) are queued with set_value() and written together by a debounced
+  * writer on a worker thread, so the GUI thread never waits on the disk.
+  */
+class SettingsStore : public QObject {
+    Q_OBJECT
+public:
+    SettingsStore(QObject *parent = 0);
+    ~SettingsStore();
+
+    // the store created by the main window, available to rooms and accounts
+    static SettingsStore *instance() {return s_instance;}
+
+    QSettings *settings() const {return m_settings;}
+    OptionsPtr options() const {return m_options;}
+
+    QVariant value(const QString &key,
+                   const QVariant &default_value = QVariant()) const;
+    // queue a value for the next write, it can be read back immediately
+    void set_value(const QString &key, const QVariant &value);
+    void flush(); // write everything queued right now and wait for it
+
+    public slots:
+        void reload_options(); // rebuild the options snapshot
+
+private:
+    static SettingsStore *s_instance;
+    QSettings *m_settings; // used for everything that isn't queued
+    OptionsPtr m_options; // current options snapshot
+    QHash<QString, QVariant> m_values; // every value set through the store
+    QHash<QString, QVariant> m_pending; // values waiting to be written
+    QTimer *m_timer; // debounces writes
+    QFuture<void> m_write; // the write currently running, if any
+
+    private slots:
+        void write_pending();
+
+signals:
+    void options_changed(OptionsPtr options);
+};
+
+#endif // SETTINGS_STORE_H
@@ -23,9 +23,11 @@ THE SOFTWARE.
 #ifndef TALKERACCOUNT_H
 #define TALKERACCOUNT_H
 
-#include <QtGui>
+#include <QtCore>
 #include <QtNetwork>
 #include <QtScript>
+
+#include "memory_usage.h"
 // forward declarations
 
 class TalkerRoom;
@@ -46,29 +48,33 @@ public:
     QString token() const {return m_token;}
     QString domain() const {return m_domain;}
     QMap<QString, int> avail_rooms() const {return m_avail_rooms;}
-    QList<TalkerRoom*> active_rooms() const {return m_active_rooms;}
+    QList<TalkerRoom*> active_rooms() const {return m_active_rooms.values();}
+    // a connected room, or 0
+    TalkerRoom *active_room(const int room_id) const {
+        return m_active_rooms.value(room_id);
+    }
 
+    // use a connection pool shared with other accounts for web requests
+    void set_network(QNetworkAccessManager *net);
+    // nothing headless shows avatars, so it can skip downloading them
+    bool fetch_avatars() const {return m_fetch_avatars;}
+    void set_fetch_avatars(const bool fetch) {m_fetch_avatars = fetch;}
     void set_name(const QString &name);
     void set_token(const QString &token);
     void set_domain(const QString &domain);
     void open_room(const int room_id);
     void close_room(const int room_id);
     void save(QSettings &s);
-
-    /**
-      * Static method that shows a configuration dialog for a user-account token
-      * as well as the talkerapp.com subdomain the user wants to connect to.
-      * After the dialog is accepted the new account object is created on the
-      * heap and passed back to the caller.
-      */
-    static TalkerAccount* create_new(QObject *account_owner,
-                                     QWidget *dialog_parent=0);
+    // what the account itself holds, its rooms report their own usage
+    MemoryUsage memory_usage() const;
+    void trim_caches(); // for this account and all of its rooms
+    // one shared copy of a sender's name for the rows of all our rooms
+    QString intern_name(const QString &name);
 
     public slots:
         // open a connection to this account on talkerapp.com
         void logout();
         void get_available_rooms(); // send a request for the list of rooms
-        bool edit();
 
 private:
     QString m_name; // string used to identify this account
@@ -78,14 +84,27 @@ private:
     QMap<QString, QVariant> m_open_rooms; // which rooms (ids) were open on this
                                           // account last
     QMap<QString, int> m_avail_rooms; // which rooms can be joined (name, id)
-    QList<TalkerRoom*> m_active_rooms; // rooms we're connected to
+    QHash<int, QString> m_room_names; // m_avail_rooms the other way around
+    QHash<int, TalkerRoom*> m_rooms; // rooms connecting or connected, by id
+    QHash<int, TalkerRoom*> m_active_rooms; // rooms we're connected to
     QNetworkAccessManager *m_net; // used to for web requests
     QScriptEngine *m_engine; // used to parse JSON we get from the SSL sockets
+    bool m_rooms_restored; // did we already restore rooms this session
+    bool m_fetch_avatars; // download avatars of the users in our rooms
+    QSet<QString> m_names; // see intern_name()
 
     void setup_network(); // make the object we need to list rooms, and chat
+    // fill rooms from a rooms.json body, false if it isn't a room list
+    bool parse_rooms(const QString &reply, QMap<QString, int> &rooms);
+    void set_avail_rooms(const QMap<QString, int> &rooms);
+    void restore_rooms(); // join the rooms that were open last session
+    bool is_room_open(const int room_id) const {
+        return m_rooms.contains(room_id);
+    }
 
     private slots:
-        void rooms_request_finished(QNetworkReply *r);
+        void rooms_request_finished();
+        void rooms_ssl_errors(const QList<QSslError> &errors);
         void on_room_connected(const TalkerRoom *room);
         void on_room_disconnected(TalkerRoom *room);
 
@@ -95,6 +114,10 @@ signals:
     void room_connected(const TalkerRoom *room);
     void room_disconnected(int room_id);
     void new_status_message(const QString &msg) const;
+    // no rooms were open last session, someone has to pick what to join
+    void choose_rooms(const TalkerAccount &acct);
+    void login_failed(const TalkerAccount &acct); // the token was refused
+    void error(const QString &title, const QString &message) const;
 };
 
 #endif // TALKERACCOUNT_H
@@ -23,14 +23,37 @@ THE SOFTWARE.
 #ifndef TALKERROOM_H
 #define TALKERROOM_H
 
-#include <QtGui>
+#include <QtCore>
 #include <QtNetwork>
 #include <QtScript>
 
 #include "talker_account.h"
+#include "settings_store.h"
+#include "event_filter.h"
+#include "memory_usage.h"
+#include "metrics.h"
 
 class TalkerUser;
+class WireRecorder;
+
+/**
+  * A chat message as the room decoded it, handed to whatever shows or
+  * stores messages
+  */
+struct RoomMessage {
+    QString event_id;
+    QDateTime time;
+    int user_id;
+    QString user_name;
+    QString content; // html entities already decoded
+    QStringList highlights; // highlight words found in content
+};
 
+/**
+  * Protocol and state of one room: the socket, the users in the room and
+  * the events coming in. Only needs QtCore, QtNetwork and QtScript, drawing
+  * the room is left to a RoomView so the same core runs headless.
+  */
 class TalkerRoom : public QObject {
     Q_OBJECT
 public:
@@ -40,14 +63,37 @@ public:
 
     int id() const {return m_id;}
     QString name() const {return m_name;}
+    TalkerAccount *account() const {return m_acct;}
     // create a socket to the given room and start chatting
     void join_room() const;
-    QTableView *get_widget() const {return m_chat;}
+    // feed raw bytes from the server, complete lines are handled as events
+    void ingest(const QByteArray &data);
     QMap<int, TalkerUser*> get_users() const {return m_users;}
+    const TalkerUser *user(const int user_id) const {
+        return m_users.value(user_id);
+    }
+    OptionsPtr options() const {return m_opts;}
+
+    // when the data holding the current event was read and parsed, for
+    // tracing the event's way to the screen
+    qint64 read_usec() const {return m_read_usec;}
+    qint64 parsed_usec() const {return m_parsed_usec;}
+    // the server is still replaying messages sent before we connected
+    bool is_catching_up() const {return m_catching_up;}
 
     void save();
     void load();
 
+    MemoryUsage memory_usage() const;
+    void trim_caches();
+
+    // turn the html entities the server sends back into plain text
+    static QString decode_entities(const QString &content);
+    // keep every room's saved state (last event id, seen event ids) under
+    // name, so another program reading the same settings has its own;
+    // set before any room is made, empty for the GUI
+    static void set_state_name(const QString &name) {s_state_name = name;}
+
     public slots:
         void logout();
         void stay_alive();
@@ -55,6 +101,7 @@ public:
         void socket_ssl_errors(const QList<QSslError> &errors);
         void socket_ready_read();
         void socket_disconnected();
+        void socket_error(QAbstractSocket::SocketError error);
         void socket_state_changed(QAbstractSocket::SocketState);
 
         void handle_users(const QScriptValue &val);
@@ -65,11 +112,9 @@ public:
         void handle_leave(const QScriptValue &val);
         void submit_message(const QString &msg);
 
-        void on_options_changed(QSettings*);
+        void on_options_changed(OptionsPtr opts);
         void on_user_updated(const TalkerUser *user);
 
-        void system_message(const QString &time, const QString &message);
-
 private:
     int m_id; // id of the room
     int m_user_id; // our user id we logged in with
@@ -80,10 +125,28 @@ private:
     QNetworkAccessManager *m_net; // handles web requests for us
     QScriptEngine *m_engine; // used to parse JSON we get from the SSL sockets
     QTimer *m_timer; // used for keep-alives
-    QTableView *m_chat; // shows messages
-    QStandardItemModel *m_model; // stores messages
     QMap<int, TalkerUser*> m_users; // holds records of who is in room
-
+    OptionsPtr m_opts; // options snapshot shared with the other rooms
+    EventFilter m_seen; // event ids we already have, to drop replays
+
+    QByteArray m_read_buffer; // holds a partial line between reads
+    bool m_ingesting; // in ingest(), a nested call only appends its data
+    WireRecorder *m_recorder; // only set when recording traffic
+    qint64 m_read_usec; // when the data being ingested was read
+    qint64 m_parsed_usec; // when the current event finished parsing
+    RoomMetrics *m_metrics; // counters for the metrics endpoint
+    qint64 m_ping_usec; // when the unanswered keep-alive went out, or 0
+    QDateTime m_connected_at; // when the current connection was made
+    bool m_catching_up; // no message newer than m_connected_at yet
+    // the socket got connected, so disconnected() follows any error
+    bool m_reached;
+    bool m_connect_failed; // the failed connect was already reported
+
+    static QString s_state_name; // see set_state_name()
+
+    bool handle_event(const QByteArray &line); // false if we had to log out
+    QString state_group() const; // settings group of our saved state
+    QString filter_path() const; // where m_seen is kept between sessions
     TalkerUser *add_user(const QScriptValue &user);
     QDateTime time_from_message(const QScriptValue &val);
     void status_message(const QString &msg) const;
@@ -91,10 +154,20 @@ private:
 signals:
     void connected(const TalkerRoom *room);
     void disconnected(TalkerRoom *room);
-    void message_received(const QString &sender, const QString &content, const TalkerRoom *room);
+    // every new event exactly as the server sent it, replays already dropped
+    void event_received(const TalkerRoom *room, const QString &event_id,
+                        const QByteArray &line);
+    void message_added(const RoomMessage &msg);
+    // joins and leaves, worth a line in the chat but not a message
+    void system_message(const QDateTime &time, const QString &message);
+    void message_received(const QString &sender, const QString &content,
+                          const QStringList &highlights,
+                          const TalkerRoom *room);
     void users_updated(const TalkerRoom *room);
     void user_updated(const TalkerRoom *room, const TalkerUser *user);
     void new_status_message(const QString &msg) const;
+    // something the user should know about, e.g. the server sent an error
+    void error(const QString &title, const QString &message) const;
 };
 
 #endif // TALKERROOM_H
@@ -24,7 +24,7 @@ THE SOFTWARE.
 #define TALKER_USER_H
 
 #include <QObject>
-#include <QIcon>
+#include <QByteArray>
 
 class QNetworkAccessManager;
 
@@ -39,7 +39,7 @@ public:
     QString name;
     QString email;
     int id;
-    QIcon avatar;
+    QByteArray avatar_data; // image as gravatar sent it, empty until loaded
     bool idle;
 
     bool valid() const {return id != -1;}
@@ -0,0 +1,61 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef TEXT_ARENA_H
+#define TEXT_ARENA_H
+
+#include <QtCore>
+
+// where a string was put in a TextArena
+struct TextRef {
+    TextRef() : chunk(0), offset(0), size(0) {}
+    quint32 chunk;
+    quint32 offset; // in bytes
+    quint32 size; // of the UTF-8, in bytes
+};
+Q_DECLARE_TYPEINFO(TextRef, Q_PRIMITIVE_TYPE);
+
+/**
+  * Append-only store of strings as UTF-8, packed into large chunks instead
+  * of one allocation each. Strings can't be removed; the owner copies what
+  * it still needs into a new arena once enough of this one is garbage.
+  */
+class TextArena {
+public:
+    TextArena();
+
+    TextRef add(const QString &text);
+    QString text(const TextRef &ref) const; // decoded again on every call
+
+    qint64 bytes() const {return m_bytes;} // allocated, slack included
+    qint64 used() const {return m_used;} // by the strings added so far
+
+private:
+    QVector<QByteArray> m_chunks; // each keeps the capacity it started with
+    int m_current; // chunk small strings go into, -1 before the first
+    qint64 m_bytes;
+    qint64 m_used;
+
+    Q_DISABLE_COPY(TextArena)
+};
+
+#endif // TEXT_ARENA_H
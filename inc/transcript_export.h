@@ -0,0 +1,99 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef TRANSCRIPT_EXPORT_H
+#define TRANSCRIPT_EXPORT_H
+
+#include <QtCore>
+
+#include "room_history.h"
+
+/**
+  * Formats records into a file through a fixed size buffer, so memory use
+  * doesn't grow with the transcript.
+  */
+class TranscriptWriter {
+public:
+    enum Format {Html = 0, JsonLines = 1, Text = 2};
+
+    TranscriptWriter(QIODevice *out, const Format format);
+
+    // the format that goes with a file name's extension, Text if unknown
+    static Format format_for(const QString &path);
+
+    bool begin(const QString &room_name); // false once a write failed
+    bool write(const HistoryRecord &record);
+    bool finish(); // closes the document and writes what's buffered
+
+private:
+    QIODevice *m_out;
+    Format m_format;
+    QByteArray m_buffer; // never grows past BUFFER_BYTES
+    bool m_ok; // every write so far succeeded
+
+    void put(const QByteArray &data);
+    bool drain(); // hand m_buffer to the device
+};
+
+/**
+  * Writes a room's transcript on a worker thread. Records come from the
+  * room's history file, read a page at a time, or from a list handed over
+  * by the view when there is no history. Reports progress as it goes and
+  * stops at the next page once cancelled.
+  */
+class TranscriptExport : public QObject {
+    Q_OBJECT
+public:
+    // stream the history file up to its current size
+    TranscriptExport(const QString &room_name, const QString &history_path,
+                     const qint64 history_size, const QString &out_path);
+    // write records already in memory
+    TranscriptExport(const QString &room_name,
+                     const QList<HistoryRecord> &records,
+                     const QString &out_path);
+    ~TranscriptExport();
+
+    void start(); // moves the export to its thread and starts writing
+
+signals:
+    void progress(int permille);
+    void finished(bool ok, const QString &error); // no error if cancelled
+
+    public slots:
+        // safe to call from any thread, connect with Qt::DirectConnection
+        // since our own thread is busy writing
+        void cancel();
+
+private:
+    QString m_room_name;
+    QString m_history_path; // empty when writing m_records
+    qint64 m_history_size;
+    QList<HistoryRecord> m_records;
+    QString m_out_path;
+    QAtomicInt m_cancelled;
+    QThread m_thread;
+
+    private slots:
+        void run();
+};
+
+#endif // TRANSCRIPT_EXPORT_H
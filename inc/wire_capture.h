@@ -0,0 +1,94 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef WIRE_CAPTURE_H
+#define WIRE_CAPTURE_H
+
+#include <QtCore>
+
+class TalkerRoom;
+
+/**
+  * Tees the raw bytes a room reads off its socket into a capture file, each
+  * read stamped with its offset from the start of the capture. The account
+  * token is redacted before anything is written.
+  */
+class WireRecorder {
+public:
+    WireRecorder(const QString &path, const QString &room_name,
+                 const int room_id, const QByteArray &token);
+    ~WireRecorder();
+
+    bool is_open() const {return m_file.isOpen();}
+    void record(const QByteArray &data);
+
+private:
+    QFile m_file;
+    QDataStream m_out;
+    QTime m_clock; // started when the capture is opened
+    QByteArray m_token; // removed from everything we write
+    QByteArray m_held; // end of the last read that may start the token
+};
+
+/**
+  * Feeds a capture made by WireRecorder back into a room, either with the
+  * original timing or as fast as possible, and keeps track of how long the
+  * room spent ingesting it.
+  */
+class WireReplayer : public QObject {
+    Q_OBJECT
+public:
+    WireReplayer(QObject *parent = 0);
+
+    bool load(const QString &path);
+    QString room_name() const {return m_room_name;}
+    int room_id() const {return m_room_id;}
+
+    void start(TalkerRoom *room, const bool fast);
+
+    int reads() const {return m_chunks.size();}
+    qint64 bytes() const {return m_bytes;}
+    qint64 ingest_ms() const {return m_ingest_ms;} // time spent in the room
+
+private:
+    struct Chunk {
+        qint64 offset_ms;
+        QByteArray data;
+    };
+    QList<Chunk> m_chunks;
+    QString m_room_name;
+    int m_room_id;
+    qint64 m_bytes;
+    qint64 m_ingest_ms;
+    int m_next; // next chunk to feed
+    bool m_fast;
+    TalkerRoom *m_room;
+    QTime m_clock; // started with the replay
+
+    private slots:
+        void feed(); // feed every chunk that is due
+
+signals:
+    void finished();
+};
+
+#endif // WIRE_CAPTURE_H
@@ -0,0 +1,194 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtGui>
+
+#include "chat_delegate.h"
+#include "message_item.h"
+
+// room for the text to breathe, the same as the view's own items
+static const int TEXT_MARGIN = 3;
+// lines of text kept laid out by one view, a few screenfuls
+static const int CACHED_LINES = 2000;
+
+ChatDelegate::ChatDelegate(QObject *parent)
+    : QStyledItemDelegate(parent)
+    , m_layouts(CACHED_LINES)
+    , m_big(0)
+    , m_big_serial(0)
+{}
+
+ChatDelegate::~ChatDelegate() {
+    delete m_big;
+}
+
+void ChatDelegate::forget(const quint64 serial) {
+    m_layouts.remove(serial);
+    if (m_big && m_big_serial == serial) {
+        delete m_big;
+        m_big = 0;
+    }
+}
+
+void ChatDelegate::clear_cache() {
+    m_layouts.clear();
+    delete m_big;
+    m_big = 0;
+}
+
+const MessageItem *ChatDelegate::message_at(const QModelIndex &index) {
+    // the table may be showing a filter of the room's model
+    QModelIndex source = index;
+    const QAbstractProxyModel *proxy;
+    while ((proxy = qobject_cast<const QAbstractProxyModel*>(
+            source.model()))) {
+        source = proxy->mapToSource(source);
+    }
+    const QStandardItemModel *model =
+            qobject_cast<const QStandardItemModel*>(source.model());
+    if (!model) {
+        return 0;
+    }
+    QStandardItem *item = model->itemFromIndex(source);
+    if (!item || item->type() != MessageItem::Type) {
+        return 0;
+    }
+    return static_cast<const MessageItem*>(item);
+}
+
+QRect ChatDelegate::text_rect(const QStyleOptionViewItem &option) {
+    return option.rect.adjusted(TEXT_MARGIN, 0, -TEXT_MARGIN, 0);
+}
+
+ChatDelegate::RowLayout *ChatDelegate::layout_for(const MessageItem *item,
+                                                  const QFont &font,
+                                                  const int width) const {
+    RowLayout *row = 0;
+    if (m_big && m_big_serial == item->serial()) {
+        row = m_big;
+        m_big = 0;
+    } else {
+        row = m_layouts.take(item->serial());
+    }
+    if (row && (row->width != width || row->font != font)) {
+        delete row; // everything wraps differently now
+        row = 0;
+    }
+    if (!row) {
+        row = new RowLayout;
+        row->width = width;
+        row->font = font;
+        row->height = 0;
+        row->lines = 0;
+    }
+
+    QFontMetrics fm(font);
+    QTextOption option;
+    option.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
+    for (int i = row->layouts.size(); i < item->segment_count(); ++i) {
+        QTextLayout *layout = new QTextLayout(item->text(i), font);
+        layout->setTextOption(option);
+        layout->beginLayout();
+        qreal height = 0;
+        forever {
+            QTextLine line = layout->createLine();
+            if (!line.isValid()) {
+                break;
+            }
+            line.setLineWidth(width);
+            line.setPosition(QPointF(0, height));
+            height += line.height();
+        }
+        layout->endLayout();
+        row->layouts.append(layout);
+        row->tops.append(row->height);
+        row->height += qMax(qCeil(height), fm.height());
+        row->lines += layout->lineCount();
+    }
+    if (row->lines > m_layouts.maxCost()) {
+        delete m_big;
+        m_big = row;
+        m_big_serial = item->serial();
+        return row;
+    }
+    // put it back, the cache now owns it and may drop it at any time
+    m_layouts.insert(item->serial(), row, qMax(row->lines, 1));
+    return row;
+}
+
+void ChatDelegate::paint(QPainter *painter,
+                         const QStyleOptionViewItem &option,
+                         const QModelIndex &index) const {
+    const MessageItem *item = message_at(index);
+    if (!item) {
+        QStyledItemDelegate::paint(painter, option, index);
+        return;
+    }
+
+    // not initStyleOption(), that asks the item for all of its text
+    QStyleOptionViewItemV4 opt(option);
+    QVariant background = index.data(Qt::BackgroundRole);
+    if (background.canConvert<QBrush>()) {
+        opt.backgroundBrush = qvariant_cast<QBrush>(background);
+    }
+    const QWidget *widget = opt.widget;
+    QStyle *style = widget ? widget->style() : QApplication::style();
+    style->drawControl(QStyle::CE_ItemViewItem, &opt, painter, widget);
+
+    QRect r = text_rect(opt);
+    RowLayout *row = layout_for(item, opt.font, qMax(r.width(), 1));
+
+    // only the part of a tall row that's on screen is drawn
+    QRect visible = opt.rect;
+    const QAbstractScrollArea *area =
+            qobject_cast<const QAbstractScrollArea*>(widget);
+    if (area) {
+        visible &= area->viewport()->rect();
+    }
+    int first = qUpperBound(row->tops, visible.top() - r.top()) -
+                row->tops.begin() - 1;
+
+    painter->save();
+    painter->setClipRect(visible);
+    painter->setPen(opt.palette.color(opt.state & QStyle::State_Selected
+                                      ? QPalette::HighlightedText
+                                      : QPalette::Text));
+    for (int i = qMax(first, 0); i < row->layouts.size(); ++i) {
+        int top = r.top() + row->tops.at(i);
+        if (top > visible.bottom()) {
+            break;
+        }
+        row->layouts.at(i)->draw(painter, QPointF(r.left(), top));
+    }
+    painter->restore();
+}
+
+QSize ChatDelegate::sizeHint(const QStyleOptionViewItem &option,
+                             const QModelIndex &index) const {
+    const MessageItem *item = message_at(index);
+    if (!item) {
+        return QStyledItemDelegate::sizeHint(option, index);
+    }
+    int width = qMax(text_rect(option).width(), 1);
+    RowLayout *row = layout_for(item, option.font, width);
+    return QSize(width + 2 * TEXT_MARGIN, row->height);
+}
@@ -0,0 +1,360 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtGui>
+
+#include "chat_filter.h"
+#include "message_item.h"
+
+// removed rows the index may hold before it's rebuilt, at least
+static const int STALE_ROWS_MIN = 1000;
+
+/**
+  * Add serial to a postings list, rows are indexed a segment at a time so
+  * a repeat is always the last entry
+  */
+static void add_posting(QVector<quint64> *postings, const quint64 serial) {
+    if (postings->isEmpty() || postings->last() != serial) {
+        postings->append(serial);
+    }
+}
+
+ChatFilter::ChatFilter(QStandardItemModel *source, QObject *parent)
+    : QSortFilterProxyModel(parent)
+    , m_source(source)
+    , m_indexed(false)
+    , m_live_rows(0)
+    , m_stale_rows(0)
+    , m_user_id(-1)
+{
+    // connected before start() sets the source model, so the index is up
+    // to date by the time the proxy tests new rows
+    connect(source, SIGNAL(rowsInserted(QModelIndex,int,int)),
+            SLOT(on_rows_inserted(QModelIndex,int,int)));
+    connect(source, SIGNAL(rowsAboutToBeRemoved(QModelIndex,int,int)),
+            SLOT(on_rows_removing(QModelIndex,int,int)));
+    connect(source, SIGNAL(rowsRemoved(QModelIndex,int,int)),
+            SLOT(on_rows_removed()));
+    connect(source, SIGNAL(dataChanged(QModelIndex,QModelIndex)),
+            SLOT(on_data_changed(QModelIndex,QModelIndex)));
+    connect(source, SIGNAL(modelReset()), SLOT(on_model_reset()));
+    setDynamicSortFilter(true); // new and grown rows are tested as they come
+}
+
+void ChatFilter::start() {
+    if (!m_indexed) {
+        build_index();
+        setSourceModel(m_source);
+    }
+}
+
+void ChatFilter::stop() {
+    m_indexed = false;
+    m_by_sender.clear();
+    m_sender_names.clear();
+    m_by_word.clear();
+    m_rows.clear();
+    m_live_rows = m_stale_rows = 0;
+    m_user_id = -1;
+    m_terms.clear();
+    m_matches.clear();
+    // no mapping to keep up while the filter isn't used
+    setSourceModel(0);
+}
+
+void ChatFilter::set_query(const int user_id, const QString &text) {
+    QStringList terms = words(text);
+    if (user_id == m_user_id && terms == m_terms) {
+        return; // e.g. only punctuation typed
+    }
+    start();
+
+    // narrower if nothing was dropped and every term only grew
+    bool narrower = is_active() && (m_user_id == -1 || m_user_id == user_id)
+                    && terms.size() >= m_terms.size();
+    for (int i = 0; narrower && i < m_terms.size(); ++i) {
+        narrower = terms.at(i).startsWith(m_terms.at(i));
+    }
+    int old_user_id = m_user_id;
+    QStringList old_terms = m_terms;
+    m_user_id = user_id;
+    m_terms = terms;
+
+    if (!narrower) {
+        refresh_matches();
+    } else {
+        // the new matches are among the old ones
+        if (user_id != old_user_id) {
+            QSet<quint64>::iterator it = m_matches.begin();
+            while (it != m_matches.end()) {
+                if (m_rows.value(*it).user_id == user_id) {
+                    ++it;
+                } else {
+                    it = m_matches.erase(it);
+                }
+            }
+        }
+        for (int i = 0; i < terms.size(); ++i) {
+            if (i >= old_terms.size() || terms.at(i) != old_terms.at(i)) {
+                narrow_matches(terms.at(i));
+            }
+        }
+    }
+    invalidateFilter();
+}
+
+void ChatFilter::refresh_matches() {
+    m_matches.clear();
+    if (!is_active()) {
+        return;
+    }
+    bool everything = true; // no constraint applied yet
+    if (m_user_id != -1) {
+        m_matches = QSet<quint64>::fromList(
+                m_by_sender.value(m_user_id).toList());
+        everything = false;
+    }
+    foreach(QString term, m_terms) {
+        if (everything) {
+            m_matches = lookup(term);
+            everything = false;
+        } else {
+            m_matches.intersect(lookup(term));
+        }
+    }
+}
+
+void ChatFilter::narrow_matches(const QString &term) {
+    if (postings(term, m_matches.size()) > m_matches.size()) {
+        // early keystrokes match most rows, testing what is left is cheaper
+        QSet<quint64>::iterator it = m_matches.begin();
+        while (it != m_matches.end()) {
+            if (has_prefix(m_rows.value(*it).item, term)) {
+                ++it;
+            } else {
+                it = m_matches.erase(it);
+            }
+        }
+    } else {
+        m_matches.intersect(lookup(term));
+    }
+}
+
+QMap<QString, int> ChatFilter::senders() const {
+    QMap<QString, int> names;
+    QHash<int, QString>::const_iterator it = m_sender_names.constBegin();
+    for (; it != m_sender_names.constEnd(); ++it) {
+        names.insert(it.value(), it.key());
+    }
+    return names;
+}
+
+bool ChatFilter::filterAcceptsRow(int source_row,
+                                  const QModelIndex &source_parent) const {
+    Q_UNUSED(source_parent);
+    if (!is_active()) {
+        return true;
+    }
+    MessageItem *item = message(source_row);
+    return item && m_matches.contains(item->serial());
+}
+
+void ChatFilter::build_index() {
+    m_indexed = true;
+    m_by_sender.clear();
+    m_sender_names.clear();
+    m_by_word.clear();
+    m_rows.clear();
+    m_live_rows = m_stale_rows = 0;
+    for (int r = 0; r < m_source->rowCount(); ++r) {
+        index_row(r);
+    }
+}
+
+void ChatFilter::index_segment(const quint64 serial, const QString &text) {
+    foreach(QString word, words(text)) {
+        add_posting(&m_by_word[word], serial);
+    }
+}
+
+void ChatFilter::index_row(const int row) {
+    MessageItem *item = message(row);
+    if (!item) {
+        return; // system rows can't be searched
+    }
+    QStandardItem *sender = m_source->item(row, 1);
+    int user_id = sender->data(Qt::UserRole).toInt();
+    add_posting(&m_by_sender[user_id], item->serial());
+    m_sender_names.insert(user_id, sender->text());
+    IndexedRow indexed = {item, user_id};
+    m_rows.insert(item->serial(), indexed);
+    for (int s = 0; s < item->segment_count(); ++s) {
+        index_segment(item->serial(), item->text(s));
+    }
+    ++m_live_rows;
+}
+
+MessageItem *ChatFilter::message(const int row) const {
+    QStandardItem *item = m_source->item(row, 2);
+    if (!item || item->type() != MessageItem::Type) {
+        return 0;
+    }
+    return static_cast<MessageItem*>(item);
+}
+
+bool ChatFilter::matches(const int row) const {
+    MessageItem *item = message(row);
+    if (!item) {
+        return false;
+    }
+    if (m_user_id != -1 &&
+        m_source->item(row, 1)->data(Qt::UserRole).toInt() != m_user_id) {
+        return false;
+    }
+    QStringList row_words;
+    for (int s = 0; s < item->segment_count(); ++s) {
+        row_words << words(item->text(s));
+    }
+    foreach(QString term, m_terms) {
+        bool found = false;
+        for (int w = 0; !found && w < row_words.size(); ++w) {
+            found = row_words.at(w).startsWith(term);
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+QSet<quint64> ChatFilter::lookup(const QString &term) const {
+    QSet<quint64> found;
+    QMap<QString, Postings>::const_iterator it = m_by_word.lowerBound(term);
+    for (; it != m_by_word.constEnd() && it.key().startsWith(term); ++it) {
+        foreach(quint64 serial, it.value()) {
+            found.insert(serial);
+        }
+    }
+    return found;
+}
+
+int ChatFilter::postings(const QString &term, const int limit) const {
+    int total = 0;
+    QMap<QString, Postings>::const_iterator it = m_by_word.lowerBound(term);
+    for (; it != m_by_word.constEnd() && it.key().startsWith(term) &&
+           total <= limit; ++it) {
+        total += it.value().size();
+    }
+    return total;
+}
+
+bool ChatFilter::has_prefix(const MessageItem *item, const QString &term) {
+    if (!item) {
+        return false;
+    }
+    for (int s = 0; s < item->segment_count(); ++s) {
+        foreach(QString word, words(item->text(s))) {
+            if (word.startsWith(term)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+QStringList ChatFilter::words(const QString &text) {
+    QStringList found;
+    QString word;
+    for (int i = 0; i <= text.size(); ++i) {
+        if (i < text.size() && text.at(i).isLetterOrNumber()) {
+            word += text.at(i).toCaseFolded();
+        } else if (!word.isEmpty()) {
+            found << word;
+            word.clear();
+        }
+    }
+    return found;
+}
+
+void ChatFilter::on_rows_inserted(const QModelIndex &parent, int first,
+                                  int last) {
+    Q_UNUSED(parent);
+    if (!m_indexed) {
+        return;
+    }
+    for (int r = first; r <= last; ++r) {
+        index_row(r);
+        if (is_active() && matches(r)) {
+            m_matches.insert(message(r)->serial());
+        }
+    }
+}
+
+void ChatFilter::on_rows_removing(const QModelIndex &parent, int first,
+                                  int last) {
+    Q_UNUSED(parent);
+    if (!m_indexed) {
+        return;
+    }
+    for (int r = first; r <= last; ++r) {
+        MessageItem *item = message(r);
+        if (item) {
+            m_matches.remove(item->serial());
+            m_rows.remove(item->serial());
+            --m_live_rows;
+            ++m_stale_rows;
+        }
+    }
+}
+
+void ChatFilter::on_rows_removed() {
+    if (m_indexed && m_stale_rows > qMax(m_live_rows, STALE_ROWS_MIN)) {
+        build_index();
+        refresh_matches(); // the same rows, minus the removed serials
+    }
+}
+
+void ChatFilter::on_data_changed(const QModelIndex &top_left,
+                                 const QModelIndex &bottom_right) {
+    if (!m_indexed || top_left.column() > 2 || bottom_right.column() < 2) {
+        return;
+    }
+    for (int r = top_left.row(); r <= bottom_right.row(); ++r) {
+        MessageItem *item = message(r);
+        if (!item) {
+            continue;
+        }
+        // rows only change by growing a segment at the end
+        index_segment(item->serial(),
+                      item->text(item->segment_count() - 1));
+        if (is_active() && matches(r)) {
+            m_matches.insert(item->serial());
+        }
+    }
+}
+
+void ChatFilter::on_model_reset() {
+    if (m_indexed) {
+        build_index();
+        refresh_matches();
+    }
+}
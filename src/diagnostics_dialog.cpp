@@ -0,0 +1,248 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtGui>
+
+#include "diagnostics_dialog.h"
+#include "latency_tracer.h"
+#include "memory_usage.h"
+#include "process_stats.h"
+#include "talker_account.h"
+#include "talker_room.h"
+#include "room_view.h"
+
+DiagnosticsDialog::DiagnosticsDialog(const QList<TalkerAccount*> *accounts,
+                                     QWidget *parent)
+    : QDialog(parent)
+    , m_tabs(new QTabWidget(this))
+    , m_latency(new QTableWidget(this))
+    , m_memory(new QTreeWidget(this))
+    , m_process_memory(new QLabel(this))
+    , m_accounts(accounts)
+    , m_timer(new QTimer(this))
+{
+    setWindowTitle(tr("Diagnostics"));
+    setWindowIcon(QIcon(":img/icons/information.png"));
+    resize(640, 400);
+
+    QStringList labels;
+    labels << tr("Room") << tr("Stage") << tr("Messages") << tr("p50")
+           << tr("p90") << tr("p99");
+    m_latency->setColumnCount(labels.size());
+    m_latency->setHorizontalHeaderLabels(labels);
+    m_latency->verticalHeader()->hide();
+    m_latency->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_latency->setAlternatingRowColors(true);
+    m_latency->horizontalHeader()->setStretchLastSection(true);
+
+    QWidget *latency_page = new QWidget(this);
+    QVBoxLayout *latency_layout = new QVBoxLayout(latency_page);
+    QLabel *help = new QLabel(tr("Time each message spends from the socket "
+                                 "read to the first paint of its row. "
+                                 "Percentiles are bucket upper bounds."),
+                              latency_page);
+    help->setWordWrap(true);
+    QPushButton *btn_export = new QPushButton(tr("Export Trace..."),
+                                              latency_page);
+    connect(btn_export, SIGNAL(clicked()), SLOT(export_trace()));
+    latency_layout->addWidget(help);
+    latency_layout->addWidget(m_latency, 10);
+    latency_layout->addWidget(btn_export, 0, Qt::AlignRight);
+    m_tabs->addTab(latency_page, tr("Latency"));
+
+    QStringList mem_labels;
+    mem_labels << tr("Account / Room") << tr("Rows") << tr("Chat")
+               << tr("Users") << tr("Avatars") << tr("Network")
+               << tr("Script") << tr("Total");
+    m_memory->setColumnCount(mem_labels.size());
+    m_memory->setHeaderLabels(mem_labels);
+    m_memory->setAlternatingRowColors(true);
+    m_memory->setRootIsDecorated(true);
+
+    QWidget *memory_page = new QWidget(this);
+    QVBoxLayout *memory_layout = new QVBoxLayout(memory_page);
+    QPushButton *btn_trim = new QPushButton(tr("Trim Caches"), memory_page);
+    btn_trim->setToolTip(tr("Run the script garbage collectors, drop cached "
+                            "pixmaps and remove chat rows past the "
+                            "configured message limit"));
+    connect(btn_trim, SIGNAL(clicked()), SLOT(trim_caches()));
+    QHBoxLayout *memory_buttons = new QHBoxLayout();
+    memory_buttons->addWidget(m_process_memory, 10);
+    memory_buttons->addWidget(btn_trim);
+    memory_layout->addWidget(m_memory, 10);
+    memory_layout->addLayout(memory_buttons);
+    m_tabs->addTab(memory_page, tr("Memory"));
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Close,
+                                                     Qt::Horizontal, this);
+    connect(buttons, SIGNAL(rejected()), SLOT(reject()));
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(m_tabs, 10);
+    layout->addWidget(buttons);
+
+    m_timer->setInterval(1000);
+    connect(m_timer, SIGNAL(timeout()), SLOT(refresh()));
+}
+
+void DiagnosticsDialog::showEvent(QShowEvent *e) {
+    QDialog::showEvent(e);
+    refresh();
+    m_timer->start();
+}
+
+void DiagnosticsDialog::hideEvent(QHideEvent *e) {
+    QDialog::hideEvent(e);
+    m_timer->stop(); // no reason to do any work while nobody looks
+}
+
+/**
+  * Format microseconds so small and large numbers are both readable
+  */
+static QString format_usec(const qint64 usec) {
+    if (usec < 1000) {
+        return QString("%1 us").arg(usec);
+    } else if (usec < 1000000) {
+        return QString("%1 ms").arg(usec / 1000.0, 0, 'f', 1);
+    }
+    return QString("%1 s").arg(usec / 1000000.0, 0, 'f', 2);
+}
+
+void DiagnosticsDialog::refresh() {
+    refresh_memory();
+
+    QList<RoomLatency*> rooms = LatencyTracer::rooms();
+    m_latency->setRowCount(rooms.size() * RoomLatency::StageCount);
+    int row = 0;
+    foreach(RoomLatency *room, rooms) {
+        for (int s = 0; s < RoomLatency::StageCount; ++s) {
+            RoomLatency::Stage stage = RoomLatency::Stage(s);
+            QStringList cells;
+            cells << (s == 0 ? room->room_name() : QString())
+                  << RoomLatency::stage_name(stage)
+                  << QString::number(room->count(stage))
+                  << format_usec(room->percentile(stage, 50))
+                  << format_usec(room->percentile(stage, 90))
+                  << format_usec(room->percentile(stage, 99));
+            for (int c = 0; c < cells.size(); ++c) {
+                QTableWidgetItem *item = m_latency->item(row, c);
+                if (!item) {
+                    item = new QTableWidgetItem();
+                    m_latency->setItem(row, c, item);
+                }
+                item->setText(cells.at(c));
+            }
+            ++row;
+        }
+    }
+}
+
+void DiagnosticsDialog::export_trace() {
+    QString path = QFileDialog::getSaveFileName(
+            this, tr("Export Trace"),
+            QDir::home().filePath("smoothtalker_trace.json"),
+            tr("Chrome Trace (*.json)"));
+    if (path.isEmpty()) {
+        return;
+    }
+    if (!LatencyTracer::export_chrome_trace(path)) {
+        QMessageBox::warning(this, tr("Export Failed"),
+                             tr("Could not write the trace to %1").arg(path));
+    }
+}
+
+/**
+  * Format a byte count as KB or MB
+  */
+static QString format_bytes(const qint64 bytes) {
+    if (bytes < 1024 * 1024) {
+        return QString("%1 KB").arg(bytes / 1024.0, 0, 'f', 1);
+    }
+    return QString("%1 MB").arg(bytes / (1024.0 * 1024.0), 0, 'f', 1);
+}
+
+/**
+  * Fill one row of the memory tree
+  */
+static void set_usage(QTreeWidgetItem *item, const QString &name,
+                      const MemoryUsage &usage) {
+    item->setText(0, name);
+    item->setText(1, QString::number(usage.model_rows));
+    item->setText(2, format_bytes(usage.model_bytes));
+    item->setText(3, QString("%1 (%2)").arg(format_bytes(usage.user_bytes))
+                  .arg(usage.users));
+    item->setText(4, QString("%1 (%2)").arg(format_bytes(usage.avatar_bytes))
+                  .arg(usage.avatars));
+    item->setText(5, QString::number(usage.net_managers));
+    item->setText(6, QString::number(usage.script_engines));
+    item->setText(7, format_bytes(usage.total_bytes()));
+}
+
+void DiagnosticsDialog::refresh_memory() {
+    int account_idx = 0;
+    foreach(TalkerAccount *a, *m_accounts) {
+        QTreeWidgetItem *acct_item = m_memory->topLevelItem(account_idx);
+        if (!acct_item) {
+            acct_item = new QTreeWidgetItem(m_memory);
+            acct_item->setExpanded(true);
+        }
+        MemoryUsage total = a->memory_usage();
+        QList<TalkerRoom*> rooms = a->active_rooms();
+        for (int i = 0; i < rooms.size(); ++i) {
+            QTreeWidgetItem *room_item = acct_item->child(i);
+            if (!room_item) {
+                room_item = new QTreeWidgetItem(acct_item);
+            }
+            MemoryUsage usage = rooms.at(i)->memory_usage();
+            RoomView *view = rooms.at(i)->findChild<RoomView*>();
+            if (view) {
+                usage += view->memory_usage();
+            }
+            set_usage(room_item, rooms.at(i)->name(), usage);
+            total += usage;
+        }
+        while (acct_item->childCount() > rooms.size()) {
+            delete acct_item->takeChild(acct_item->childCount() - 1);
+        }
+        set_usage(acct_item, a->name(), total);
+        ++account_idx;
+    }
+    while (m_memory->topLevelItemCount() > account_idx) {
+        delete m_memory->takeTopLevelItem(account_idx);
+    }
+    m_process_memory->setText(tr("Process resident memory: %1 (peak %2)")
+                              .arg(format_bytes(process_rss_bytes()))
+                              .arg(format_bytes(process_peak_rss_bytes())));
+}
+
+void DiagnosticsDialog::trim_caches() {
+    foreach(TalkerAccount *a, *m_accounts) {
+        a->trim_caches();
+        foreach(TalkerRoom *r, a->active_rooms()) {
+            RoomView *view = r->findChild<RoomView*>();
+            if (view) {
+                view->trim_caches();
+            }
+        }
+    }
+    QPixmapCache::clear(); // avatars are decoded again when next drawn
+    refresh_memory();
+}
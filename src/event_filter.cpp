@@ -0,0 +1,153 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtCore>
+
+#include "event_filter.h"
+
+// how many of the newest ids are remembered exactly
+static const int RECENT_IDS = 4096;
+// size of one bloom generation, 2^20 bits is 128KB
+static const int BLOOM_BITS = 1 << 20;
+// ids per generation before rotating, 32 bits per id keeps false positives
+// around one in a hundred thousand with BLOOM_HASHES hashes
+static const int BLOOM_CAPACITY = BLOOM_BITS / 32;
+static const int BLOOM_HASHES = 8;
+// written at the start of saved filters
+static const quint32 FILTER_MAGIC = 0x53544546; // "STEF"
+static const quint32 FILTER_VERSION = 1;
+
+/**
+  * Second hash for double hashing, FNV-1a over the UTF-16 data. Forced odd
+  * so every probe lands on a different bit.
+  */
+static uint fnv_hash(const QString &s) {
+    uint h = 2166136261u;
+    const ushort *c = s.utf16();
+    for (int i = 0; i < s.size(); ++i) {
+        h ^= c[i];
+        h *= 16777619u;
+    }
+    return h | 1;
+}
+
+EventFilter::EventFilter()
+    : m_current(0)
+{
+    m_bloom[0] = QBitArray(BLOOM_BITS);
+    m_bloom[1] = QBitArray(BLOOM_BITS);
+    m_bloom_count[0] = 0;
+    m_bloom_count[1] = 0;
+}
+
+bool EventFilter::seen(const QString &event_id) {
+    if (m_recent.contains(event_id) || bloom_contains(event_id)) {
+        return true;
+    }
+    m_recent.insert(event_id);
+    m_recent_order.enqueue(event_id);
+    if (m_recent_order.size() > RECENT_IDS) {
+        // ids leaving the exact set are still remembered approximately
+        QString oldest = m_recent_order.dequeue();
+        m_recent.remove(oldest);
+        bloom_insert(oldest);
+    }
+    return false;
+}
+
+bool EventFilter::bloom_contains(const QString &event_id) const {
+    uint h1 = qHash(event_id);
+    uint h2 = fnv_hash(event_id);
+    for (int g = 0; g < 2; ++g) {
+        if (!m_bloom_count[g]) {
+            continue;
+        }
+        bool all_set = true;
+        for (int i = 0; i < BLOOM_HASHES && all_set; ++i) {
+            all_set = m_bloom[g].testBit((h1 + i * h2) % BLOOM_BITS);
+        }
+        if (all_set) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void EventFilter::bloom_insert(const QString &event_id) {
+    if (m_bloom_count[m_current] >= BLOOM_CAPACITY) {
+        // forget the oldest generation instead of letting the filter fill up
+        m_current = 1 - m_current;
+        m_bloom[m_current].fill(false);
+        m_bloom_count[m_current] = 0;
+    }
+    uint h1 = qHash(event_id);
+    uint h2 = fnv_hash(event_id);
+    for (int i = 0; i < BLOOM_HASHES; ++i) {
+        m_bloom[m_current].setBit((h1 + i * h2) % BLOOM_BITS);
+    }
+    m_bloom_count[m_current]++;
+}
+
+bool EventFilter::load(const QString &path) {
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream in(&f);
+    quint32 magic, version;
+    qint32 current, count0, count1;
+    QBitArray bloom0, bloom1;
+    in >> magic >> version >> current >> count0 >> count1 >> bloom0 >> bloom1;
+    if (in.status() != QDataStream::Ok || magic != FILTER_MAGIC ||
+        version != FILTER_VERSION || bloom0.size() != BLOOM_BITS ||
+        bloom1.size() != BLOOM_BITS) {
+        qWarning() << "ignoring unreadable event filter" << path;
+        return false;
+    }
+    m_current = current ? 1 : 0;
+    m_bloom_count[0] = count0;
+    m_bloom_count[1] = count1;
+    m_bloom[0] = bloom0;
+    m_bloom[1] = bloom1;
+    return true;
+}
+
+bool EventFilter::save(const QString &path) {
+    // the exact ids go in the saved filter too, they won't be loaded back
+    foreach(QString id, m_recent_order) {
+        bloom_insert(id);
+    }
+    m_recent.clear();
+    m_recent_order.clear();
+
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "could not save event filter" << path << f.errorString();
+        return false;
+    }
+    QDataStream out(&f);
+    out << FILTER_MAGIC << FILTER_VERSION << qint32(m_current)
+        << qint32(m_bloom_count[0]) << qint32(m_bloom_count[1])
+        << m_bloom[0] << m_bloom[1];
+    return out.status() == QDataStream::Ok;
+}
@@ -0,0 +1,222 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtCore>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#include <windows.h>
+#else
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
+#include "event_journal.h"
+
+// longest an event id may sit in memory before it is committed
+static const int COMMIT_DELAY_MS = 250;
+// compact once the file holds this many lines more than there are rooms
+static const int COMPACT_SLACK = 4096;
+
+EventJournal *EventJournal::s_instance = 0;
+
+static void sync_file(QFile &f) {
+    f.flush();
+#ifdef Q_OS_WIN
+    _commit(f.handle());
+#else
+    fsync(f.handle());
+#endif
+}
+
+// runs on a worker thread: append one group of lines and sync it
+static void append_group(const QString &path, const QByteArray &group) {
+    QFile f(path);
+    if (!f.open(QIODevice::Append)) {
+        qWarning() << "could not open event journal" << path
+                << f.errorString();
+        return;
+    }
+    f.write(group);
+    sync_file(f);
+}
+
+// runs on a worker thread: replace the journal with a compacted copy
+static void rewrite_journal(const QString &path, const QByteArray &lines) {
+    QFile tmp(path + ".tmp");
+    if (!tmp.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "could not compact event journal" << tmp.errorString();
+        return;
+    }
+    tmp.write(lines);
+    sync_file(tmp);
+    tmp.close();
+
+    // swap the files in one step, QFile::rename() won't replace a file;
+    // the old journal stays valid until the new one takes its place
+#ifdef Q_OS_WIN
+    bool replaced = MoveFileExW(
+            (const wchar_t*)QDir::toNativeSeparators(tmp.fileName()).utf16(),
+            (const wchar_t*)QDir::toNativeSeparators(path).utf16(),
+            MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    bool replaced = ::rename(QFile::encodeName(tmp.fileName()).constData(),
+                             QFile::encodeName(path).constData()) == 0;
+#endif
+    if (!replaced) {
+        // recover() still finds the new copy if the journal is missing
+        qWarning() << "could not replace event journal" << path;
+    }
+}
+
+EventJournal::EventJournal(const QString &path, QObject *parent)
+    : QObject(parent)
+    , m_path(path)
+    , m_timer(new QTimer(this))
+    , m_lines(0)
+    , m_compact_due(false)
+{
+    s_instance = this;
+    m_timer->setSingleShot(true);
+    m_timer->setInterval(COMMIT_DELAY_MS);
+    connect(m_timer, SIGNAL(timeout()), SLOT(commit()));
+
+    QDir().mkpath(QFileInfo(path).absolutePath()); // first run has no dir yet
+    recover();
+    compact(); // start every session with a small journal
+}
+
+EventJournal::~EventJournal() {
+    flush();
+    if (s_instance == this) {
+        s_instance = 0;
+    }
+}
+
+QString EventJournal::last_event_id(const int room_id) const {
+    return m_latest.value(room_id);
+}
+
+void EventJournal::record(const int room_id, const QString &event_id) {
+    if (event_id.isEmpty()) {
+        return;
+    }
+    m_latest.insert(room_id, event_id);
+    m_pending.insert(room_id, event_id);
+    if (!m_timer->isActive()) {
+        m_timer->start();
+    }
+}
+
+void EventJournal::flush() {
+    m_timer->stop();
+    m_write.waitForFinished();
+    if (m_compact_due) {
+        rewrite_journal(m_path, group(m_latest));
+        m_compact_due = false;
+        m_pending.clear();
+        m_lines = m_latest.size();
+    } else if (!m_pending.isEmpty()) {
+        append_group(m_path, group(m_pending));
+        m_lines += m_pending.size();
+        m_pending.clear();
+    }
+}
+
+void EventJournal::commit() {
+    m_timer->stop();
+    if (m_compact_due) {
+        compact();
+        return;
+    }
+    if (m_pending.isEmpty()) {
+        return;
+    }
+    if (m_write.isRunning()) {
+        m_timer->start(); // try again once the last group is on disk
+        return;
+    }
+
+    m_write = QtConcurrent::run(append_group, m_path, group(m_pending));
+    m_lines += m_pending.size();
+    m_pending.clear();
+
+    if (m_lines > m_latest.size() + COMPACT_SLACK) {
+        m_compact_due = true;
+        m_timer->start();
+    }
+}
+
+void EventJournal::compact() {
+    m_timer->stop();
+    if (m_write.isRunning()) {
+        m_compact_due = true;
+        m_timer->start();
+        return;
+    }
+    m_compact_due = false;
+    m_pending.clear(); // everything pending is in m_latest already
+    m_write = QtConcurrent::run(rewrite_journal, m_path, group(m_latest));
+    m_lines = m_latest.size();
+}
+
+QByteArray EventJournal::group(const QHash<int, QString> &ids) const {
+    QByteArray lines;
+    QHashIterator<int, QString> it(ids);
+    while (it.hasNext()) {
+        it.next();
+        lines += QByteArray::number(it.key()) + ' ' + it.value().toAscii()
+                 + '\n';
+    }
+    return lines;
+}
+
+void EventJournal::recover() {
+    QFile f(m_path);
+    if (!f.exists()) {
+        // a crash during compact can leave only the new copy behind
+        QFile tmp(m_path + ".tmp");
+        if (tmp.exists()) {
+            tmp.rename(m_path);
+        }
+    }
+    if (!f.open(QIODevice::ReadOnly)) {
+        return; // nothing journaled yet
+    }
+
+    QByteArray data = f.readAll();
+    int start = 0;
+    int end;
+    while ((end = data.indexOf('\n', start)) != -1) {
+        // a line without a newline was torn by a crash, so it is ignored
+        QByteArray line = data.mid(start, end - start);
+        start = end + 1;
+        int space = line.indexOf(' ');
+        bool ok = false;
+        int room_id = line.left(space).toInt(&ok);
+        if (space < 1 || !ok || space == line.size() - 1) {
+            continue;
+        }
+        m_latest.insert(room_id, QString(line.mid(space + 1)));
+    }
+    qDebug() << "recovered last event ids for" << m_latest.size() << "rooms";
+}
@@ -0,0 +1,126 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtCore>
+
+#include "highlight_matcher.h"
+
+HighlightMatcher::HighlightMatcher(const QStringList &patterns) {
+    m_fail.append(0);
+    m_out.append(-1);
+    m_dict.append(0);
+
+    // build the trie
+    foreach(QString pattern, patterns) {
+        pattern = pattern.trimmed();
+        if (pattern.isEmpty()) {
+            continue;
+        }
+        int state = 0;
+        for (int i = 0; i < pattern.size(); ++i) {
+            ushort c = pattern.at(i).toCaseFolded().unicode();
+            int next = step(state, c);
+            if (next == -1) {
+                next = m_fail.size();
+                m_next.insert((quint64(state) << 16) | c, next);
+                m_fail.append(0);
+                m_out.append(-1);
+                m_dict.append(0);
+            }
+            state = next;
+        }
+        if (m_out[state] != -1) {
+            continue; // the same word twice, maybe in another case
+        }
+        m_out[state] = m_patterns.size();
+        m_patterns << pattern;
+        m_lengths << pattern.size();
+        m_word_start << pattern.at(0).isLetterOrNumber();
+        m_word_end << pattern.at(pattern.size() - 1).isLetterOrNumber();
+    }
+
+    // fail and dictionary links, breadth first so shorter states are done
+    // before the states that depend on them
+    QMultiHash<int, QPair<ushort, int> > children;
+    QHashIterator<quint64, int> it(m_next);
+    while (it.hasNext()) {
+        it.next();
+        children.insert(int(it.key() >> 16),
+                        qMakePair(ushort(it.key() & 0xffff), it.value()));
+    }
+    QQueue<int> queue;
+    queue.enqueue(0);
+    while (!queue.isEmpty()) {
+        int state = queue.dequeue();
+        foreach(const QPair<ushort, int> &child, children.values(state)) {
+            ushort c = child.first;
+            int next = child.second;
+            int fail = 0;
+            if (state != 0) {
+                fail = m_fail[state];
+                while (fail && step(fail, c) == -1) {
+                    fail = m_fail[fail];
+                }
+                fail = qMax(step(fail, c), 0);
+            }
+            m_fail[next] = fail;
+            m_dict[next] = m_out[fail] != -1 ? fail : m_dict[fail];
+            queue.enqueue(next);
+        }
+    }
+}
+
+QStringList HighlightMatcher::match(const QString &text) const {
+    QStringList found;
+    if (m_patterns.isEmpty()) {
+        return found;
+    }
+    const QChar *chars = text.unicode();
+    const int size = text.size();
+    int state = 0;
+    for (int i = 0; i < size; ++i) {
+        ushort c = chars[i].toCaseFolded().unicode();
+        int next;
+        while ((next = step(state, c)) == -1 && state) {
+            state = m_fail[state];
+        }
+        state = qMax(next, 0);
+
+        int s = m_out[state] != -1 ? state : m_dict[state];
+        for (; s > 0; s = m_dict[s]) {
+            int p = m_out[s];
+            int start = i - m_lengths[p] + 1;
+            if (m_word_start[p] && start > 0 &&
+                chars[start - 1].isLetterOrNumber()) {
+                continue;
+            }
+            if (m_word_end[p] && i + 1 < size &&
+                chars[i + 1].isLetterOrNumber()) {
+                continue;
+            }
+            if (!found.contains(m_patterns[p])) {
+                found << m_patterns[p];
+            }
+        }
+    }
+    return found;
+}
@@ -0,0 +1,144 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtCore>
+
+#include "latency_tracer.h"
+#include "json_string.h"
+
+// traces kept per room for exporting
+static const int RECENT_TRACES = 2000;
+
+QList<RoomLatency*> LatencyTracer::s_rooms;
+
+RoomLatency::RoomLatency(const QString &room_name, const int room_id)
+    : m_room_name(room_name)
+    , m_room_id(room_id)
+{
+    memset(m_buckets, 0, sizeof(m_buckets));
+    memset(m_counts, 0, sizeof(m_counts));
+}
+
+void RoomLatency::add(const MessageTrace &trace) {
+    qint64 spans[StageCount];
+    spans[Parse] = trace.parsed - trace.read;
+    spans[Insert] = trace.inserted - trace.parsed;
+    spans[Layout] = trace.laid_out - trace.inserted;
+    spans[Paint] = trace.painted - trace.laid_out;
+    spans[Total] = trace.painted - trace.read;
+
+    for (int s = 0; s < StageCount; ++s) {
+        int bucket = 0;
+        qint64 usec = qMax(spans[s], qint64(0));
+        while (usec > 0 && bucket < BUCKETS - 1) {
+            usec >>= 1;
+            ++bucket;
+        }
+        m_buckets[s][bucket]++;
+        m_counts[s]++;
+    }
+
+    m_recent.append(trace);
+    if (m_recent.size() > RECENT_TRACES) {
+        m_recent.removeFirst();
+    }
+}
+
+qint64 RoomLatency::percentile(const Stage stage, const double pct) const {
+    if (!m_counts[stage]) {
+        return 0;
+    }
+    qint64 wanted = qint64(m_counts[stage] * pct / 100.0);
+    qint64 seen = 0;
+    for (int b = 0; b < BUCKETS; ++b) {
+        seen += m_buckets[stage][b];
+        if (seen > wanted) {
+            return qint64(1) << b;
+        }
+    }
+    return qint64(1) << (BUCKETS - 1);
+}
+
+QString RoomLatency::stage_name(const Stage stage) {
+    switch (stage) {
+    case Parse: return "parse";
+    case Insert: return "model insert";
+    case Layout: return "layout";
+    case Paint: return "paint";
+    case Total: return "total";
+    default: return QString();
+    }
+}
+
+qint64 LatencyTracer::now_usec() {
+    static QElapsedTimer clock;
+    if (!clock.isValid()) {
+        clock.start();
+    }
+    return clock.nsecsElapsed() / 1000;
+}
+
+void LatencyTracer::add_room(RoomLatency *room) {
+    s_rooms.append(room);
+}
+
+void LatencyTracer::remove_room(RoomLatency *room) {
+    s_rooms.removeAll(room);
+}
+
+bool LatencyTracer::export_chrome_trace(const QString &path) {
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "could not write trace" << path << f.errorString();
+        return false;
+    }
+    QTextStream out(&f);
+    out.setCodec("UTF-8"); // JSON, whatever the locale
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    foreach(RoomLatency *room, s_rooms) {
+        // name each room's row in the trace viewer
+        out << (first ? "" : ",\n")
+            << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+            << room->room_id() << ",\"args\":{\"name\":"
+            << json_string(room->room_name()) << "}}";
+        first = false;
+
+        foreach(MessageTrace t, room->recent()) {
+            qint64 stamps[] = {t.read, t.parsed, t.inserted, t.laid_out,
+                               t.painted};
+            for (int s = RoomLatency::Parse; s < RoomLatency::Total; ++s) {
+                out << ",\n{\"name\":\""
+                    << RoomLatency::stage_name(RoomLatency::Stage(s))
+                    << "\",\"cat\":\"message\",\"ph\":\"X\",\"pid\":1,"
+                    << "\"tid\":" << room->room_id()
+                    << ",\"ts\":" << stamps[s]
+                    << ",\"dur\":" << qMax(stamps[s + 1] - stamps[s],
+                                           qint64(0))
+                    << ",\"args\":{\"event_id\":"
+                    << json_string(t.event_id) << "}}";
+            }
+        }
+    }
+    out << "\n]}\n";
+    return true;
+}
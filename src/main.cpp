@@ -23,6 +23,44 @@ THE SOFTWARE.
 #include <QtGui/QApplication>
 #include "main_window.h"
 #include "defines.h"
+#include "talker_account.h"
+#include "talker_room.h"
+#include "room_view.h"
+#include "wire_capture.h"
+#include "process_stats.h"
+
+/**
+  * Feed a traffic capture through a room and report how long ingesting it
+  * took and how much memory it needed.
+  *   SmoothTalker --replay <capture> [--fast]
+  */
+static int replay(QApplication &a, const QString &path, const bool fast) {
+    WireReplayer replayer;
+    if (!replayer.load(path)) {
+        return 1;
+    }
+    TalkerAccount acct("replay", "", "replay", 0);
+    acct.set_fetch_avatars(false); // keep HTTP requests out of ingest time
+    TalkerRoom room(&acct, replayer.room_name(), replayer.room_id());
+    RoomView view(&room);
+    view.get_widget()->setWindowTitle(QString("Replay: %1").arg(path));
+    view.get_widget()->resize(700, 600);
+    view.get_widget()->show();
+
+    QObject::connect(&replayer, SIGNAL(finished()), &a, SLOT(quit()));
+    QTime wall;
+    wall.start();
+    replayer.start(&room, fast);
+    a.exec();
+
+    QTextStream out(stdout);
+    out << "replayed " << replayer.reads() << " reads, " << replayer.bytes()
+        << " bytes\n"
+        << "wall time: " << wall.elapsed() << " ms\n"
+        << "ingest time: " << replayer.ingest_ms() << " ms\n"
+        << "peak memory: " << process_peak_rss_bytes() / 1024 << " KB\n";
+    return 0;
+}
 
 int main(int argc, char *argv[]) {
     QApplication a(argc, argv);
@@ -30,6 +68,13 @@ int main(int argc, char *argv[]) {
     QCoreApplication::setOrganizationDomain("udpviper.com");
     QCoreApplication::setApplicationName("SmoothTalker");
     QCoreApplication::setApplicationVersion(ST_VERSION);
+
+    QStringList args = a.arguments();
+    int replay_idx = args.indexOf("--replay");
+    if (replay_idx != -1) {
+        return replay(a, args.value(replay_idx + 1), args.contains("--fast"));
+    }
+
     MainWindow w;
     w.show();
     return a.exec();
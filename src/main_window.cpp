@@ -23,11 +23,17 @@ THE SOFTWARE.
 #include "main_window.h"
 #include "custom_tab_widget.h"
 #include "options_dialog.h"
+#include "diagnostics_dialog.h"
+#include "settings_store.h"
+#include "event_journal.h"
+#include "metrics.h"
+#include "notifier.h"
 #include "ui_main_window.h"
 #include "ui_account_edit_dialog.h"
 #include "ui_about_dialog.h"
 #include "talker_account.h"
 #include "talker_room.h"
+#include "room_view.h"
 #include "talker_user.h"
 #include <QtGui>
 #include <QtNetwork>
@@ -35,15 +41,27 @@ THE SOFTWARE.
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
-    , m_settings(new QSettings(QSettings::IniFormat, QSettings::UserScope,
-                QCoreApplication::organizationName(),
-                QCoreApplication::applicationName(), this))
+    , m_store(new SettingsStore(this))
+    , m_settings(m_store->settings())
+    , m_journal(new EventJournal(QFileInfo(m_settings->fileName())
+                                 .absolutePath() + "/event_journal.log", this))
     , m_tray_menu(new QMenu(this))
     , m_tray(new QSystemTrayIcon(this))
     , m_options(new OptionsDialog(this))
+    , m_diagnostics(new DiagnosticsDialog(&m_accounts, this))
+    , m_net(new QNetworkAccessManager(this))
+    , m_metrics(0)
+    , m_notifier(new Notifier(m_tray, this))
+    , m_export(0)
+    , m_export_progress(0)
     , m_connected_accounts(0)
+    , m_background(false)
     , m_tabs(new CustomTabWidget(this))
     , m_tab_bar(new QTabBar(this))
+    , m_front(0)
+    , m_total_unread(0)
+    , m_total_mentions(0)
+    , m_label_timer(new QTimer(this))
 {
     // load up our pretty design
     ui->setupUi(this);
@@ -57,6 +75,17 @@ MainWindow::MainWindow(QWidget *parent)
 
     // add dock to the menu
     ui->menu_view->addAction(ui->dock_user_list->toggleViewAction());
+    ui->menu_view->addSeparator();
+    ui->menu_view->addAction(QIcon(":img/icons/information.png"),
+                             tr("&Diagnostics..."), this,
+                             SLOT(on_diagnostics_activated()));
+    ui->menu_view->addAction(tr("&Filter Room..."), this,
+                             SLOT(on_filter_activated()),
+                             QKeySequence::Find);
+
+    QAction *export_action = new QAction(tr("&Export Transcript..."), this);
+    connect(export_action, SIGNAL(triggered()), SLOT(on_export_activated()));
+    ui->menu_file->insertAction(ui->action_options, export_action);
 
     // put the tab widget into the main layout and hide it until we connect
     m_tabs->setVisible(false);
@@ -66,8 +95,14 @@ MainWindow::MainWindow(QWidget *parent)
     m_tabs->setTabPosition(QTabWidget::South);
     connect(m_tabs, SIGNAL(tabCloseRequested(int)), SLOT(on_tab_close(int)));
     connect(m_tabs, SIGNAL(currentChanged(int)), SLOT(on_tab_switch(int)));
+    connect(m_tab_bar, SIGNAL(tabMoved(int,int)), SLOT(on_tab_moved(int,int)));
     ui->vbox_main->insertWidget(1, m_tabs, 10);
 
+    // a busy room updates its tab label at most 4 times a second
+    m_label_timer->setSingleShot(true);
+    m_label_timer->setInterval(250);
+    connect(m_label_timer, SIGNAL(timeout()), SLOT(update_unread_labels()));
+
     //setup system tray icon
     m_tray_menu->addAction(QIcon(":img/icons/door_out.png"), tr("E&xit"),
                            this, SLOT(close()));
@@ -75,6 +110,9 @@ MainWindow::MainWindow(QWidget *parent)
     m_tray->setIcon(QIcon(":img/icons/transmit.png"));
     m_tray->setToolTip(QCoreApplication::applicationName());
     m_tray->show();
+    connect(m_store, SIGNAL(options_changed(OptionsPtr)), m_notifier,
+            SLOT(on_options_changed(OptionsPtr)));
+    m_notifier->on_options_changed(m_store->options());
 
     // make sure we have SSL access, or the whole app is worthless
     if (!QSslSocket::supportsSsl()) {
@@ -86,26 +124,68 @@ MainWindow::MainWindow(QWidget *parent)
         QTimer::singleShot(0, this, SLOT(close()));
     } else {
         load_settings();
+        start_metrics();
         load_accounts();
         login();
     }
 }
 
 MainWindow::~MainWindow() {
+    delete m_export; // cancels it and waits for its thread
+    delete m_metrics; // stops its thread
     delete ui;
 }
 
+void MainWindow::start_metrics() {
+    OptionsPtr opts = m_store->options();
+    if (!opts->metrics_enabled) {
+        return;
+    }
+    new StallMonitor(this);
+    m_metrics = new MetricsServer(opts->metrics_port);
+    m_metrics->start();
+}
+
 void MainWindow::changeEvent(QEvent *e) {
     QMainWindow::changeEvent(e);
     switch (e->type()) {
     case QEvent::LanguageChange:
         ui->retranslateUi(this);
         break;
+    case QEvent::WindowStateChange:
+        update_background_mode();
+        break;
+    case QEvent::ActivationChange:
+        if (isActiveWindow() && m_front) {
+            mark_read(m_front);
+        }
+        break;
     default:
         break;
     }
 }
 
+void MainWindow::showEvent(QShowEvent *e) {
+    QMainWindow::showEvent(e);
+    update_background_mode();
+}
+
+void MainWindow::hideEvent(QHideEvent *e) {
+    QMainWindow::hideEvent(e);
+    update_background_mode();
+}
+
+void MainWindow::update_background_mode() {
+    bool background = isMinimized() || !isVisible();
+    if (background == m_background) {
+        return;
+    }
+    m_background = background;
+    foreach(RoomEntry *entry, m_rooms.entries()) {
+        entry->view->set_background(background);
+    }
+}
+
 void MainWindow::save_settings() {
     m_settings->beginGroup("geometry");
     m_settings->setValue("size", size());
@@ -131,15 +211,42 @@ int MainWindow::load_accounts() {
         m_settings->setArrayIndex(i);
         TalkerAccount *a = new TalkerAccount("", "", "", this);
         a->load_settings(*m_settings);
-        connect(a, SIGNAL(new_rooms_available(const TalkerAccount&)),
-                SLOT(update_rooms(const TalkerAccount&)));
-        this->m_accounts.append(a);
+        add_account(a);
     }
     m_settings->endArray();
     //qDebug() << "loaded" << total_accounts << "accounts from settings";
     return total_accounts;
 }
 
+void MainWindow::add_account(TalkerAccount *acct) {
+    // every account shares our connection pool so the room list requests for
+    // several subdomains can run side by side
+    acct->set_network(m_net);
+    connect(acct, SIGNAL(new_rooms_available(const TalkerAccount&)),
+            SLOT(update_rooms(const TalkerAccount&)));
+    connect(acct, SIGNAL(room_connected(const TalkerRoom*)),
+            SLOT(on_room_connected(const TalkerRoom*)));
+    connect(acct, SIGNAL(room_disconnected(const int)),
+            SLOT(on_room_disconnected(const int)));
+    connect(acct, SIGNAL(new_status_message(const QString&)),
+            SLOT(status_message(const QString&)));
+    connect(acct, SIGNAL(choose_rooms(const TalkerAccount&)),
+            SLOT(on_choose_rooms(const TalkerAccount&)));
+    connect(acct, SIGNAL(login_failed(const TalkerAccount&)),
+            SLOT(on_login_failed(const TalkerAccount&)));
+    connect(acct, SIGNAL(error(QString,QString)),
+            SLOT(on_error(QString,QString)));
+    m_accounts.append(acct);
+    m_account_names.insert(acct->name(), acct);
+}
+
+void MainWindow::index_accounts() {
+    m_account_names.clear();
+    foreach(TalkerAccount *a, m_accounts) {
+        m_account_names.insert(a->name(), a);
+    }
+}
+
 void MainWindow::save_accounts() {
     m_settings->beginWriteArray("accounts", m_accounts.size());
     for (int i = 0; i < m_accounts.size(); ++i) {
@@ -153,6 +260,8 @@ void MainWindow::closeEvent(QCloseEvent *e) {
     qDebug() << "window closing...";
     save_settings();
     logout();
+    m_journal->flush();
+    m_store->flush(); // make sure every room's last event id hits the disk
 }
 
 void MainWindow::set_interface_enabled(const bool &enabled) {
@@ -168,43 +277,44 @@ void MainWindow::set_interface_enabled(const bool &enabled) {
 
 void MainWindow::update_rooms(const TalkerAccount &acct) {
     // TODO remove rooms when an account goes away...
-    //qDebug() << "HEY NEW ROOMS FOR" << acct.name();
-    ui->cb_rooms->clear();
-    foreach (QString name, acct.avail_rooms().keys()) {
-        //qDebug() << "ROOM:" << name;
-        ui->cb_rooms->addItem(QString("%1::%2").arg(acct.name()).arg(name),
-                              acct.avail_rooms()[name]);
+    // only replace the rooms that belong to this account, the other accounts
+    // may have already filled in their own lists
+    for (int i = ui->cb_rooms->count() - 1; i >= 0; --i) {
+        if (ui->cb_rooms->itemData(i, AccountRole).toString() == acct.name()) {
+            ui->cb_rooms->removeItem(i);
+        }
+    }
+
+    QMap<QString, int> rooms = acct.avail_rooms();
+    foreach (QString name, rooms.keys()) {
+        QString label = QString("%1::%2").arg(acct.name()).arg(name);
+        // keep the combined list sorted by label as lists trickle in
+        int pos = 0;
+        while (pos < ui->cb_rooms->count() &&
+               ui->cb_rooms->itemText(pos) < label) {
+            ++pos;
+        }
+        ui->cb_rooms->insertItem(pos, label, rooms[name]);
+        ui->cb_rooms->setItemData(pos, acct.name(), AccountRole);
     }
     ui->cb_rooms->setEnabled(ui->cb_rooms->count());
     ui->btn_join_room->setEnabled(ui->cb_rooms->count());
 }
 
 void MainWindow::join_room() {
-    int room_id = ui->cb_rooms->itemData(ui->cb_rooms->currentIndex()).toInt();
-    foreach(TalkerAccount *a, this->m_accounts) {
-        QMap<QString, int> rooms = a->avail_rooms();
-        foreach(QString name, rooms.keys()) {
-            int id = rooms[name];
-            if (id == room_id) {
-                // are we already connected to this room?
-                bool open_already = false;
-                for(int i = 0; i < m_tabs->count(); ++i) {
-                    if (m_tab_bar->tabData(i).toInt() == id) {
-                        open_already = true;
-                        break;
-                    }
-                }
-                if (!open_already)
-                    a->open_room(id);
-            }
-        }
+    int idx = ui->cb_rooms->currentIndex();
+    int room_id = ui->cb_rooms->itemData(idx).toInt();
+    QString acct_name = ui->cb_rooms->itemData(idx, AccountRole).toString();
+
+    TalkerAccount *a = m_account_names.value(acct_name);
+    if (!a || m_rooms.find(a, room_id)) {
+        return; // we're already connected to this room
     }
-    QApplication::processEvents();
+    a->open_room(room_id); // does nothing if the account can't see the room
 }
 
 void MainWindow::login() {
-    // show a list of configured accounts, and allow multiple selection for
-    // which ones to login to (ONLY IF THERE IS MORE THAN 1 ACCOUNT CONFIGURED)
+    // log in to every configured account
     int total_accounts = m_accounts.length();
     if (total_accounts < 1) {
         if (QMessageBox::question(
@@ -214,24 +324,19 @@ void MainWindow::login() {
                 ) == QMessageBox::Yes) {
 
             // they want to make a new account, open the dialog
-            TalkerAccount *acct = TalkerAccount::create_new(this, this);
+            TalkerAccount *acct = create_account(this, this);
             if (acct) { // they accepted the dialog
-                m_accounts.append(acct); // hold on to it for this session
+                add_account(acct); // hold on to it for this session
                 save_accounts(); // write it to disk
                 login(); // try again but this time we should have an account
             }
         }
-    } else if (total_accounts == 1) {
-        // get a room list for this dude...
-        m_accounts.at(0)->get_available_rooms();
-        connect(m_accounts.at(0), SIGNAL(room_connected(const TalkerRoom*)),
-                SLOT(on_room_connected(const TalkerRoom*)));
-        connect(m_accounts.at(0), SIGNAL(room_disconnected(const int)),
-                SLOT(on_room_disconnected(const int)));
-        connect(m_accounts.at(0), SIGNAL(new_status_message(const QString&)),
-                SLOT(status_message(const QString&)));
     } else {
-        // show a list of all accounts and let them login to any of them
+        // fire off the room list requests for every account at once, each
+        // account restores its own rooms as soon as its list comes back
+        foreach(TalkerAccount *a, m_accounts) {
+            a->get_available_rooms();
+        }
     }
 }
 
@@ -248,14 +353,8 @@ void MainWindow::submit_message() {
     ui->le_chat_entry->clear();
     //qDebug() << "submitting message:" << msg;
 
-    // find the active room...
-    int current_room_id = m_tab_bar->tabData(m_tab_bar->currentIndex()).toInt();
-    foreach(TalkerAccount *a, m_accounts) {
-        foreach(TalkerRoom *r, a->active_rooms()) {
-            if (r->id() == current_room_id) {
-                r->submit_message(msg);
-            }
-        }
+    if (m_front) {
+        m_front->room->submit_message(msg);
     }
     ui->le_chat_entry->setFocus();
 }
@@ -263,79 +362,103 @@ void MainWindow::submit_message() {
 void MainWindow::on_room_connected(const TalkerRoom *room) {
     m_connected_accounts++;
 
-    connect(room, SIGNAL(message_received(QString,QString,const TalkerRoom*)),
+    connect(room, SIGNAL(message_received(QString,QString,QStringList,
+                                          const TalkerRoom*)),
             SLOT(on_message_received(const QString&, const QString&,
-                                     const TalkerRoom*)));
+                                     const QStringList&, const TalkerRoom*)));
     connect(room, SIGNAL(users_updated(const TalkerRoom*)),
             SLOT(on_users_updated(const TalkerRoom*)));
     connect(room, SIGNAL(user_updated(const TalkerRoom*, const TalkerUser*)),
             SLOT(on_user_updated(const TalkerRoom*, const TalkerUser*)));
-    connect(this, SIGNAL(options_changed(QSettings*)), room,
-            SLOT(on_options_changed(QSettings*)));
-
-    emit options_changed(m_settings); // to propogate to this new room
-
-    // draw a tab for this dude.
-    //QWidget *w = room->get_widget();
-    QTableView *w = room->get_widget();
+    connect(m_store, SIGNAL(options_changed(OptionsPtr)), room,
+            SLOT(on_options_changed(OptionsPtr)));
+
+    // hand the current options to this new room
+    TalkerRoom *r = const_cast<TalkerRoom*>(room);
+    r->on_options_changed(m_store->options());
+
+    // draw a tab for this dude, the view goes away along with its room
+    RoomView *view = new RoomView(r);
+    connect(m_store, SIGNAL(options_changed(OptionsPtr)), view,
+            SLOT(on_options_changed(OptionsPtr)));
+    QWidget *w = view->get_widget();
+    RoomEntry *entry = m_rooms.add(r, view);
+    // registered first, adding the first tab switches to it right away
+    m_rooms.tab_inserted(entry, m_tabs->count());
     m_tabs->addTab(w, room->name());
-    m_tab_bar->setTabData(m_tabs->indexOf(w), room->id());
+    if (m_tabs->currentWidget() != w) {
+        view->hibernate(); // a background tab until it's switched to
+    }
+    view->set_background(m_background);
     set_interface_enabled(m_connected_accounts);
 }
 
 void MainWindow::on_room_disconnected(const int room_id) {
     qDebug() << "room disconnected" << room_id << "removing tab";
+    TalkerAccount *acct = qobject_cast<TalkerAccount*>(sender());
+    RoomEntry *entry = m_rooms.find(acct, room_id);
+    if (!entry) {
+        return; // it never connected, so it never got a tab
+    }
     m_connected_accounts--;
+    m_total_unread -= entry->counts.unread;
+    m_total_mentions -= entry->counts.mentions;
+    m_stale_labels.remove(entry);
+    if (m_front == entry) {
+        m_front = 0;
+    }
 
-    // hide any tabs, and show the label
-    for(int i = 0; i < m_tab_bar->count(); ++i) {
-        if (m_tab_bar->tabData(i).toInt() == room_id) {
-            // TODO: nuke widget
-            m_tabs->removeTab(i);
-        }
+    // forget the room before its tab goes, removing the tab switches to
+    // another one; the widget is deleted along with the room's view
+    int tab = entry->tab;
+    m_rooms.remove(acct, room_id);
+    if (tab != -1) {
+        m_tabs->removeTab(tab);
     }
     set_interface_enabled(m_connected_accounts);
 }
 
 void MainWindow::on_message_received(const QString &sender,
                                      const QString &content,
+                                     const QStringList &highlights,
                                      const TalkerRoom *room) {
-    QString path = m_settings->value("options/sound_files/message_received",
-                                     QString()).toString();
-    if (!path.isEmpty() && QFile::exists(path)) {
-        QSound::play(path);
+    RoomEntry *entry = m_rooms.find(room);
+    if (entry && (entry != m_front || !isActiveWindow())) {
+        entry->counts.unread++;
+        m_total_unread++;
+        if (!highlights.isEmpty()) {
+            entry->counts.mentions++;
+            m_total_mentions++;
+        }
+        m_stale_labels.insert(entry);
+        if (!m_label_timer->isActive()) {
+            m_label_timer->start();
+        }
     }
 
-    bool flash = m_settings->value("options/flash_when_not_active",
-                                   true).toBool();
-    if (isMinimized() && flash) {
-        m_tray->showMessage(QString("message from %1").arg(sender), content,
-                            QSystemTrayIcon::Information, 2000);
-        qApp->alert(this, 0);
-    }
+    m_notifier->notify(room, sender, content, highlights);
 }
 
 void MainWindow::on_users_updated(const TalkerRoom *room) {
-    int active_room_id = m_tab_bar->tabData(m_tabs->currentIndex()).toInt();
-    if (active_room_id != room->id()) {
+    if (!m_front || m_front->room != room) {
         return; // ignore this...
     }
-    QMap<int, TalkerUser*> users = room->get_users();
+    fill_user_list(ui->tbl_users, room->get_users());
+}
 
-    ui->tbl_users->clearContents();
-    ui->tbl_users->setRowCount(0);
-    int i = 0;
+void MainWindow::fill_user_list(QTableWidget *table,
+                                const QMap<int, TalkerUser*> &users) {
+    table->clearContents();
+    table->setRowCount(0);
     foreach(TalkerUser *u, users.values()) {
-        add_user_to_room_list(u);
-        ++i;
+        add_user_to_room_list(table, u);
     }
 }
 
 void MainWindow::on_user_updated(const TalkerRoom *room,
                                  const TalkerUser *user) {
     //qDebug() << "in mainwindow, got user_updated for" << user->name;
-    int active_room_id = m_tab_bar->tabData(m_tabs->currentIndex()).toInt();
-    if (active_room_id != room->id()) {
+    if (!m_front || m_front->room != room) {
         return; // ignore this...
     }
     bool found = false;
@@ -347,7 +470,7 @@ void MainWindow::on_user_updated(const TalkerRoom *room,
             continue;
         }
         if (item->data(Qt::UserRole).toInt() == user->id) {
-            item->setIcon(user->avatar);
+            item->setIcon(RoomView::avatar(user));
             if (user->idle) {
                 item->setForeground(Qt::gray);
                 item->setText(tr("(IDLE) %1").arg(user->name));
@@ -360,50 +483,232 @@ void MainWindow::on_user_updated(const TalkerRoom *room,
         }
     }
     if (!found) {
-        add_user_to_room_list(user);
+        add_user_to_room_list(ui->tbl_users, user);
     }
 }
 
-void MainWindow::add_user_to_room_list(const TalkerUser *user) {
+void MainWindow::add_user_to_room_list(QTableWidget *table,
+                                       const TalkerUser *user) {
     QTableWidgetItem *name_item = new QTableWidgetItem(user->name);
     name_item->setData(Qt::UserRole, user->id);
-    if (!user->avatar.isNull()) {
-        name_item->setIcon(user->avatar);
+    QIcon avatar = RoomView::avatar(user);
+    if (!avatar.isNull()) {
+        name_item->setIcon(avatar);
     }
-    ui->tbl_users->insertRow(0);
-    ui->tbl_users->setItem(0, 0, name_item);
-    ui->tbl_users->sortByColumn(0);
+    table->insertRow(0);
+    table->setItem(0, 0, name_item);
+    table->sortByColumn(0);
 }
 
 void MainWindow::on_tab_close(int tab_idx) {
     //qDebug() << "request to close tab index:" << tab_idx;
-    int room_id = m_tab_bar->tabData(tab_idx).toInt();
-    foreach(TalkerAccount *a, m_accounts) {
-        a->close_room(room_id);
+    RoomEntry *entry = m_rooms.at_tab(tab_idx);
+    if (entry) {
+        entry->account->close_room(entry->room->id());
     }
 }
 
+void MainWindow::on_tab_moved(int from, int to) {
+    m_rooms.tab_moved(from, to);
+}
+
 void MainWindow::on_tab_switch(int new_idx) {
     //qDebug() << "request to switch to tab index:" << new_idx;
-    int room_id = m_tab_bar->tabData(new_idx).toInt();
-    foreach(TalkerAccount *a, m_accounts) {
-        foreach(TalkerRoom *r, a->active_rooms()) {
-            if (r->id() == room_id) {
-                on_users_updated(r);
-            }
+    // only the tab in front keeps its rows as items
+    RoomEntry *entry = m_rooms.at_tab(new_idx);
+    if (m_front && m_front != entry) {
+        m_front->view->hibernate();
+    }
+    m_front = entry;
+    if (!entry) {
+        return;
+    }
+    mark_read(entry);
+    entry->view->wake();
+    on_users_updated(entry->room);
+}
+
+void MainWindow::mark_read(RoomEntry *entry) {
+    if (!entry->counts.unread && !entry->counts.mentions) {
+        return;
+    }
+    m_total_unread -= entry->counts.unread;
+    m_total_mentions -= entry->counts.mentions;
+    entry->counts = UnreadCount();
+    m_stale_labels.insert(entry);
+    update_unread_labels(); // the user is looking, don't wait for the timer
+}
+
+void MainWindow::update_unread_labels() {
+    if (m_stale_labels.isEmpty()) {
+        return;
+    }
+    foreach(RoomEntry *entry, m_stale_labels) {
+        if (entry->tab == -1) {
+            continue;
         }
+        const UnreadCount &counts = entry->counts;
+        QString name = entry->room->name();
+        QString label = name;
+        if (counts.mentions) {
+            label = tr("%1 (%2, @%3)").arg(name)
+                    .arg(counts.unread).arg(counts.mentions);
+        } else if (counts.unread) {
+            label = tr("%1 (%2)").arg(name).arg(counts.unread);
+        }
+        m_tab_bar->setTabText(entry->tab, label);
+        m_tab_bar->setTabTextColor(entry->tab, counts.mentions
+                                   ? QColor(Qt::red)
+                                   : m_tab_bar->palette().color(
+                                           QPalette::WindowText));
+    }
+    m_stale_labels.clear();
+
+    QString tip = QCoreApplication::applicationName();
+    if (m_total_mentions) {
+        tip = tr("%1 - %2 unread, %3 mentioning you").arg(tip)
+              .arg(m_total_unread).arg(m_total_mentions);
+    } else if (m_total_unread) {
+        tip = tr("%1 - %2 unread").arg(tip).arg(m_total_unread);
     }
+    m_tray->setToolTip(tip);
 }
 
 void MainWindow::on_options_activated() {
     if (m_options->exec()) { // accepted
         m_options->save_settings(m_settings);
-        emit options_changed(m_settings);
+        m_store->reload_options(); // tells every room about the new options
     } else { // cancel
         m_options->load_settings(m_settings);
     }
 }
 
+void MainWindow::on_diagnostics_activated() {
+    m_diagnostics->show();
+    m_diagnostics->raise();
+}
+
+void MainWindow::on_filter_activated() {
+    if (m_front && m_front->view) {
+        m_front->view->show_filter();
+    }
+}
+
+void MainWindow::on_export_activated() {
+    if (m_export) {
+        m_export_progress->show(); // one export at a time
+        m_export_progress->raise();
+        return;
+    }
+    if (!m_front || !m_front->view) {
+        status_message(tr("Open a room to export its transcript"));
+        return;
+    }
+    QString name = m_front->room->name();
+    QString path = QFileDialog::getSaveFileName(
+            this, tr("Export Transcript"),
+            QDir::home().filePath(QString(name).replace('/', '_') + ".html"),
+            tr("HTML (*.html);;JSON Lines (*.jsonl);;Text (*.txt)"));
+    if (path.isEmpty()) {
+        return;
+    }
+    m_export = m_front->view->export_transcript(path);
+    m_export_progress = new QProgressDialog(
+            tr("Exporting %1...").arg(name), tr("Cancel"), 0, 1000, this);
+    m_export_progress->setMinimumDuration(500);
+    connect(m_export, SIGNAL(progress(int)), m_export_progress,
+            SLOT(setValue(int)));
+    // the export's thread is busy writing, so cancel from ours
+    connect(m_export_progress, SIGNAL(canceled()), m_export, SLOT(cancel()),
+            Qt::DirectConnection);
+    connect(m_export, SIGNAL(finished(bool,QString)),
+            SLOT(on_export_finished(bool,QString)));
+    m_export->start();
+}
+
+void MainWindow::on_export_finished(bool ok, const QString &error) {
+    delete m_export;
+    m_export = 0;
+    m_export_progress->deleteLater();
+    m_export_progress = 0;
+    if (ok) {
+        status_message(tr("Transcript exported"));
+    } else if (!error.isEmpty()) {
+        QMessageBox::warning(this, tr("Export Failed"),
+                             tr("Could not export the transcript: %1")
+                             .arg(error));
+    }
+}
+
+void MainWindow::on_choose_rooms(const TalkerAccount &acct) {
+    QMap<QString, int> rooms = acct.avail_rooms();
+    QString to_join = QInputDialog::getItem(
+            this, tr("Choose which room to join"),
+            tr("Select a room"), rooms.keys(), 0, false);
+    if (to_join.isEmpty()) {
+        return;
+    }
+    foreach(TalkerAccount *a, m_accounts) {
+        if (a == &acct) {
+            a->open_room(rooms[to_join]);
+        }
+    }
+}
+
+void MainWindow::on_login_failed(const TalkerAccount &acct) {
+    int want_to_edit = QMessageBox::question(
+            this, tr("Unauthorized Login"),
+            tr("The credentials you supplied for account '%1' are "
+               "invalid. Would you like to edit this account?")
+            .arg(acct.name()),
+            QMessageBox::Yes, QMessageBox::No
+    );
+    if (want_to_edit != QMessageBox::Yes) {
+        return;
+    }
+    foreach(TalkerAccount *a, m_accounts) {
+        if (a == &acct && edit_account(a, this)) {
+            index_accounts(); // the name may have changed
+            save_accounts();
+            a->get_available_rooms(); // try again
+        }
+    }
+}
+
+void MainWindow::on_error(const QString &title, const QString &message) {
+    QMessageBox::warning(this, title, message);
+}
+
+TalkerAccount *MainWindow::create_account(QObject *account_owner,
+                                          QWidget *dialog_parent) {
+    TalkerAccount *acct = new TalkerAccount("", "", "", account_owner);
+
+    if (!edit_account(acct, dialog_parent)) {
+        // if they cancel delete the temp object we made
+        acct->deleteLater();
+        acct = NULL; // give back nothing
+    }
+
+    return acct;
+}
+
+bool MainWindow::edit_account(TalkerAccount *acct, QWidget *dialog_parent) {
+    QDialog *d = new QDialog(dialog_parent);
+    Ui::AccountEditDialog ui;
+    ui.setupUi(d); // paint the dialog
+    ui.le_name->setText(acct->name());
+    ui.le_token->setText(acct->token());
+    ui.le_domain->setText(acct->domain());
+    bool accepted = d->exec();
+    if (accepted) { // only change the account if they accepted the dialog
+        acct->set_name(ui.le_name->text().trimmed());
+        acct->set_token(ui.le_token->text().trimmed());
+        acct->set_domain(ui.le_domain->text().trimmed());
+    }
+    d->deleteLater();
+    return accepted;
+}
+
 void MainWindow::on_about_activated() {
     QDialog *d = new QDialog(this);
     Ui::AboutDialog *dui = new Ui::AboutDialog();
@@ -0,0 +1,126 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtGui>
+
+#include "message_item.h"
+
+// rows whose decoded text is kept, a few screenfuls
+static const int RECENT_ROWS = 256;
+
+// items are only made on the GUI thread
+static quint64 s_next_serial = 0;
+// decoded segments of the rows asked for last, by serial
+static QCache<quint64, QStringList> s_recent(RECENT_ROWS);
+
+MessageItem::MessageItem(TextArena *arena, const QDateTime &time,
+                         const QString &text, const QString &event_id)
+    : QStandardItem()
+    , m_serial(++s_next_serial)
+    , m_arena(arena)
+    , m_text_size(0)
+    , m_arena_bytes(0)
+{
+    append(time, text, event_id);
+}
+
+MessageItem::~MessageItem() {
+    s_recent.remove(m_serial);
+}
+
+QVariant MessageItem::data(int role) const {
+    if (role == Qt::DisplayRole || role == Qt::EditRole) {
+        return texts().join(QString(QLatin1Char('\n')));
+    } else if (role == Qt::UserRole) {
+        return event_id(0);
+    }
+    return QStandardItem::data(role);
+}
+
+QStandardItem *MessageItem::clone() const {
+    MessageItem *item = new MessageItem(*this);
+    item->m_serial = ++s_next_serial;
+    return item;
+}
+
+void MessageItem::append(const QDateTime &time, const QString &text,
+                         const QString &event_id) {
+    MessageSegment segment;
+    segment.text = m_arena->add(text);
+    segment.event_id = m_arena->add(event_id);
+    segment.time = time.toTime_t();
+    m_segments.append(segment);
+    m_text_size += text.size();
+    m_arena_bytes += segment.text.size + segment.event_id.size;
+
+    QStringList *recent = s_recent.object(m_serial);
+    if (recent) {
+        recent->append(text); // already decoded
+    }
+    emitDataChanged(); // does nothing until we're in a model
+}
+
+QString MessageItem::text(const int segment) const {
+    return texts().at(segment);
+}
+
+QString MessageItem::event_id(const int segment) const {
+    return m_arena->text(m_segments.at(segment).event_id);
+}
+
+QDateTime MessageItem::time(const int segment) const {
+    return QDateTime::fromTime_t(m_segments.at(segment).time);
+}
+
+void MessageItem::move_to(TextArena *arena) {
+    for (int i = 0; i < m_segments.size(); ++i) {
+        MessageSegment &seg = m_segments[i];
+        seg.text = arena->add(m_arena->text(seg.text));
+        seg.event_id = arena->add(m_arena->text(seg.event_id));
+    }
+    m_arena = arena;
+}
+
+QStringList MessageItem::texts() const {
+    QStringList *recent = s_recent.object(m_serial);
+    if (!recent) {
+        recent = new QStringList();
+        foreach(const MessageSegment &seg, m_segments) {
+            recent->append(m_arena->text(seg.text));
+        }
+        s_recent.insert(m_serial, recent);
+    }
+    return *recent;
+}
+
+TimeItem::TimeItem(const QDateTime &time, const qint64 offset)
+    : QStandardItem()
+    , m_time(time.toTime_t())
+    , m_offset(offset)
+{}
+
+QVariant TimeItem::data(int role) const {
+    if (role == Qt::DisplayRole || role == Qt::EditRole) {
+        return time().toString("h:mmap");
+    }
+    return QStandardItem::data(role);
+}
@@ -0,0 +1,221 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtCore>
+#include <QtNetwork>
+
+#include "metrics.h"
+#include "process_stats.h"
+
+// how often the GUI thread is checked for stalls
+static const int STALL_TICK_MS = 100;
+// lateness below this is normal timer jitter, not a stall
+static const int STALL_THRESHOLD_MS = 20;
+
+QMutex Metrics::s_lock;
+QList<RoomMetrics*> Metrics::s_rooms;
+QAtomicInt Metrics::s_gui_stall_msec(0);
+QAtomicInt Metrics::s_gui_stall_max_msec(0);
+
+RoomMetrics *Metrics::room(const int room_id, const QString &room_name) {
+    QMutexLocker lock(&s_lock);
+    foreach(RoomMetrics *m, s_rooms) {
+        if (m->room_id == room_id) {
+            return m;
+        }
+    }
+    RoomMetrics *m = new RoomMetrics(room_id, room_name);
+    s_rooms.append(m);
+    return m;
+}
+
+void Metrics::add_gui_stall(const int msec) {
+    s_gui_stall_msec.fetchAndAddRelaxed(msec);
+    int max = s_gui_stall_max_msec;
+    while (msec > max && !s_gui_stall_max_msec.testAndSetRelaxed(max, msec)) {
+        max = s_gui_stall_max_msec;
+    }
+}
+
+/**
+  * Escape a label value for the Prometheus text format
+  */
+static QByteArray label(const QString &value) {
+    QString escaped(value);
+    escaped.replace("\\", "\\\\").replace("\"", "\\\"").replace("\n", "\\n");
+    return escaped.toUtf8();
+}
+
+/**
+  * Add HELP and TYPE lines for a metric
+  */
+static void describe(QByteArray &out, const char *name, const char *type,
+                     const char *help) {
+    out += QByteArray("# HELP ") + name + " " + help + "\n";
+    out += QByteArray("# TYPE ") + name + " " + type + "\n";
+}
+
+QByteArray Metrics::render() {
+    QList<RoomMetrics*> rooms;
+    {
+        QMutexLocker lock(&s_lock);
+        rooms = s_rooms;
+    }
+
+    struct Series {
+        const char *name;
+        const char *type;
+        const char *help;
+    };
+    static const Series series[] = {
+        {"smoothtalker_room_events_total", "counter",
+         "Events received, use rate() for events per second."},
+        {"smoothtalker_room_received_bytes_total", "counter",
+         "Bytes read from the room socket."},
+        {"smoothtalker_room_parse_errors_total", "counter",
+         "Lines from the server that failed to parse."},
+        {"smoothtalker_room_reconnects_total", "counter",
+         "Connects to the room after the first one."},
+        {"smoothtalker_room_keepalive_rtt_seconds", "gauge",
+         "Time from the last keep-alive ping to the next data from the "
+         "server."},
+        {"smoothtalker_room_queue_depth_bytes", "gauge",
+         "Bytes read from the socket that are not handled yet."}
+    };
+
+    QByteArray out;
+    for (int s = 0; s < int(sizeof(series) / sizeof(series[0])); ++s) {
+        describe(out, series[s].name, series[s].type, series[s].help);
+        foreach(RoomMetrics *m, rooms) {
+            QByteArray value;
+            switch (s) {
+            case 0: value = QByteArray::number(m->events.value());
+                break;
+            case 1: value = QByteArray::number(m->bytes.value());
+                break;
+            case 2: value = QByteArray::number(int(m->parse_errors));
+                break;
+            case 3: value = QByteArray::number(qMax(int(m->connects) - 1, 0));
+                break;
+            case 4: value = QByteArray::number(
+                        int(m->keepalive_rtt_usec) / 1000000.0, 'f', 6);
+                break;
+            default: value = QByteArray::number(int(m->queue_depth));
+                break;
+            }
+            out += QByteArray(series[s].name) + "{room=\"" +
+                   label(m->room_name) + "\",room_id=\"" +
+                   QByteArray::number(m->room_id) + "\"} " + value + "\n";
+        }
+    }
+
+    describe(out, "smoothtalker_gui_stall_seconds_total", "counter",
+             "Time the GUI event loop was stalled.");
+    out += "smoothtalker_gui_stall_seconds_total " +
+           QByteArray::number(int(s_gui_stall_msec) / 1000.0, 'f', 3) + "\n";
+    describe(out, "smoothtalker_gui_stall_max_seconds", "gauge",
+             "Longest GUI event loop stall since the last scrape.");
+    out += "smoothtalker_gui_stall_max_seconds " +
+           QByteArray::number(s_gui_stall_max_msec.fetchAndStoreRelaxed(0)
+                              / 1000.0, 'f', 3) + "\n";
+    describe(out, "smoothtalker_process_resident_memory_bytes", "gauge",
+             "Resident memory of the process.");
+    out += "smoothtalker_process_resident_memory_bytes " +
+           QByteArray::number(process_rss_bytes()) + "\n";
+    return out;
+}
+
+StallMonitor::StallMonitor(QObject *parent)
+    : QObject(parent)
+    , m_timer(new QTimer(this))
+{
+    connect(m_timer, SIGNAL(timeout()), SLOT(tick()));
+    m_timer->start(STALL_TICK_MS);
+    m_clock.start();
+}
+
+void StallMonitor::tick() {
+    int late = int(m_clock.restart()) - STALL_TICK_MS;
+    if (late > STALL_THRESHOLD_MS) {
+        Metrics::add_gui_stall(late);
+    }
+}
+
+MetricsServer::MetricsServer(const quint16 port)
+    : QObject(0)
+    , m_port(port)
+    , m_server(0)
+{}
+
+MetricsServer::~MetricsServer() {
+    m_thread.quit();
+    m_thread.wait();
+    delete m_server;
+}
+
+void MetricsServer::start() {
+    moveToThread(&m_thread);
+    m_thread.start();
+    QMetaObject::invokeMethod(this, "listen", Qt::QueuedConnection);
+}
+
+void MetricsServer::listen() {
+    m_server = new QTcpServer(); // no parent, deleted in our destructor
+    connect(m_server, SIGNAL(newConnection()), SLOT(on_connection()));
+    if (!m_server->listen(QHostAddress::LocalHost, m_port)) {
+        qWarning() << "metrics endpoint could not listen on port" << m_port
+                << m_server->errorString();
+        return;
+    }
+    qDebug() << "serving metrics on http://127.0.0.1:" << m_port
+            << "/metrics";
+}
+
+void MetricsServer::on_connection() {
+    while (m_server->hasPendingConnections()) {
+        QTcpSocket *s = m_server->nextPendingConnection();
+        connect(s, SIGNAL(readyRead()), SLOT(on_ready_read()));
+        connect(s, SIGNAL(disconnected()), s, SLOT(deleteLater()));
+    }
+}
+
+void MetricsServer::on_ready_read() {
+    QTcpSocket *s = qobject_cast<QTcpSocket*>(QObject::sender());
+    if (!s || !s->canReadLine()) {
+        return;
+    }
+    QList<QByteArray> request = s->readLine().trimmed().split(' ');
+    QByteArray status("200 OK");
+    QByteArray body;
+    if (request.value(0) != "GET") {
+        status = "405 Method Not Allowed";
+    } else if (request.value(1) != "/metrics" && request.value(1) != "/") {
+        status = "404 Not Found";
+    } else {
+        body = Metrics::render();
+    }
+    s->write("HTTP/1.0 " + status + "\r\n"
+             "Content-Type: text/plain; version=0.0.4\r\n"
+             "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+             "Connection: close\r\n\r\n" + body);
+    s->disconnectFromHost();
+}
@@ -0,0 +1,148 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtGui>
+
+#include "notifier.h"
+#include "talker_room.h"
+
+// how long messages are gathered before notifying about them
+static const int COALESCE_MSEC = 1500;
+
+Notifier::Notifier(QSystemTrayIcon *tray, QWidget *window)
+    : QObject(window)
+    , m_tray(tray)
+    , m_window(window)
+    , m_opts(new Options())
+    , m_sound(0)
+    , m_timer(new QTimer(this))
+{
+    m_timer->setSingleShot(true);
+    m_timer->setInterval(COALESCE_MSEC);
+    connect(m_timer, SIGNAL(timeout()), SLOT(flush()));
+}
+
+void Notifier::on_options_changed(OptionsPtr opts) {
+    m_opts = opts;
+    const QString &path = opts->sound_message_received;
+    if (path == m_sound_path && (m_sound || path.isEmpty())) {
+        return; // already loaded
+    }
+    delete m_sound;
+    m_sound = 0;
+    m_sound_path = path;
+    if (!path.isEmpty() && QFile::exists(path)) {
+        m_sound = new QSound(path, this);
+    }
+}
+
+void Notifier::notify(const TalkerRoom *room, const QString &sender,
+                      const QString &content, const QStringList &highlights) {
+    if (room->is_catching_up()) {
+        return; // backlog the server replays after connecting
+    }
+    int idx = m_pending_index.value(room, -1);
+    if (idx == -1) {
+        idx = m_pending.size();
+        m_pending_index.insert(room, idx);
+        m_pending.append(Pending());
+        m_pending[idx].room_name = room->name();
+    }
+    Pending &p = m_pending[idx];
+    p.messages++;
+    p.last_sender = sender;
+    p.last_content = content;
+    // decided as the message comes in, the window may be restored by the
+    // time the burst is over
+    if (!highlights.isEmpty() && !m_window->isActiveWindow()) {
+        p.popup = true;
+        p.mention_sender = sender;
+        foreach(QString word, highlights) {
+            if (!p.highlights.contains(word)) {
+                p.highlights << word;
+            }
+        }
+    } else if (m_window->isMinimized() && m_opts->flash_when_not_active) {
+        p.popup = true;
+    }
+    if (!m_timer->isActive()) {
+        m_timer->start();
+    }
+}
+
+void Notifier::flush() {
+    if (m_pending.isEmpty()) {
+        return;
+    }
+    if (m_sound && m_sound->isFinished()) {
+        m_sound->play(); // once per burst, never on top of itself
+    }
+
+    QList<Pending> popups;
+    foreach(const Pending &p, m_pending) {
+        if (p.popup) {
+            popups << p;
+        }
+    }
+    m_pending.clear();
+    m_pending_index.clear();
+    if (popups.isEmpty()) {
+        return;
+    }
+
+    QString title;
+    QString body;
+    int msecs = 2000;
+    if (popups.size() == 1) {
+        const Pending &p = popups.first();
+        if (!p.highlights.isEmpty()) {
+            title = tr("%1 mentioned %2 in %3").arg(p.mention_sender)
+                    .arg(p.highlights.join(", ")).arg(p.room_name);
+            msecs = 5000;
+        } else if (p.messages == 1) {
+            title = tr("message from %1").arg(p.last_sender);
+        } else {
+            title = tr("%1 new messages in %2").arg(p.messages)
+                    .arg(p.room_name);
+        }
+        body = p.messages == 1 ? p.last_content
+               : QString("%1: %2").arg(p.last_sender).arg(p.last_content);
+    } else {
+        int total = 0;
+        QStringList lines;
+        foreach(const Pending &p, popups) {
+            total += p.messages;
+            if (!p.highlights.isEmpty()) {
+                lines << tr("%1 in %2, mentioning %3").arg(p.messages)
+                         .arg(p.room_name).arg(p.highlights.join(", "));
+                msecs = 5000;
+            } else {
+                lines << tr("%1 in %2").arg(p.messages).arg(p.room_name);
+            }
+        }
+        title = tr("%1 new messages in %2 rooms").arg(total)
+                .arg(popups.size());
+        body = lines.join("\n");
+    }
+    m_tray->showMessage(title, body, QSystemTrayIcon::Information, msecs);
+    qApp->alert(m_window, 0);
+}
@@ -61,6 +61,14 @@ void OptionsDialog::save_settings(QSettings *s) {
     s->setValue("flash_when_not_active", ui->cb_flash->isChecked());
     s->setValue("reopen_last_session_rooms", ui->cb_auto_join->isChecked());
 
+    QStringList highlights;
+    foreach(QString line, ui->te_highlights->toPlainText().split('\n')) {
+        if (!line.trimmed().isEmpty()) {
+            highlights << line.trimmed();
+        }
+    }
+    s->setValue("highlight_patterns", highlights);
+
     s->beginGroup("sound_files");
     s->setValue("message_received", ui->le_sound_msg_received->text());
 
@@ -77,6 +85,9 @@ void OptionsDialog::load_settings(QSettings *s) {
     ui->cb_auto_join->setChecked(
             s->value("reopen_last_session_rooms", true).toBool());
 
+    ui->te_highlights->setPlainText(
+            s->value("highlight_patterns").toStringList().join("\n"));
+
     int limit = s->value("total_messages_per_room", 0).toInt();
     for (int i = 0; i < ui->cb_message_limit->count(); ++i) {
         if (ui->cb_message_limit->itemData(i, Qt::UserRole) == limit) {
@@ -0,0 +1,90 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtCore>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+#include "process_stats.h"
+
+#if defined(Q_OS_LINUX)
+/**
+  * Read one "Vm...:   1234 kB" line out of /proc/self/status
+  */
+static qint64 proc_status_kb(const char *field) {
+    QFile f("/proc/self/status");
+    if (!f.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    QByteArray prefix(field);
+    prefix += ':';
+    foreach(QByteArray line, f.readAll().split('\n')) {
+        if (line.startsWith(prefix)) {
+            QList<QByteArray> parts = line.mid(prefix.size()).simplified()
+                                      .split(' ');
+            return parts.value(0).toLongLong();
+        }
+    }
+    return 0;
+}
+#endif
+
+qint64 process_rss_bytes() {
+#if defined(Q_OS_LINUX)
+    return proc_status_kb("VmRSS") * 1024;
+#elif defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        return pmc.WorkingSetSize;
+    }
+    return 0;
+#else
+    return 0;
+#endif
+}
+
+qint64 process_peak_rss_bytes() {
+#if defined(Q_OS_LINUX)
+    return proc_status_kb("VmHWM") * 1024;
+#elif defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        return pmc.PeakWorkingSetSize;
+    }
+    return 0;
+#elif defined(Q_OS_MAC)
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss; // already in bytes on mac
+#elif defined(Q_OS_UNIX)
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return qint64(usage.ru_maxrss) * 1024;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,193 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtCore>
+
+#include "room_history.h"
+
+// bigger than any message the server sends, anything larger is corruption
+static const quint32 MAX_RECORD_BYTES = 4 * 1024 * 1024;
+
+static QByteArray encode(const HistoryRecord &r) {
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out << quint8(r.kind) << r.time << qint32(r.user_id) << r.user_name
+        << r.content << r.event_id << r.highlighted;
+    return data;
+}
+
+static bool decode(const QByteArray &data, HistoryRecord *r) {
+    QDataStream in(data);
+    quint8 kind;
+    qint32 user_id;
+    in >> kind >> r->time >> user_id >> r->user_name >> r->content
+       >> r->event_id >> r->highlighted;
+    r->kind = kind;
+    r->user_id = user_id;
+    return in.status() == QDataStream::Ok;
+}
+
+static quint32 read_length(QFile *file, const qint64 offset) {
+    uchar buf[4];
+    if (!file->seek(offset) || file->read((char*)buf, 4) != 4) {
+        return 0;
+    }
+    return qFromBigEndian<quint32>(buf);
+}
+
+RoomHistory::RoomHistory(const QString &path)
+    : m_file(path)
+    , m_size(0)
+{
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qWarning() << "could not open history" << path
+                << m_file.errorString();
+        return;
+    }
+    m_size = m_file.size();
+    if (!tail_is_valid()) {
+        // a crash cut the last write short, drop the torn record so that
+        // backwards reads start from a whole one again
+        qint64 valid = last_valid_end();
+        qWarning() << "history" << path << "has a torn record, cutting it"
+                << "from" << m_size << "to" << valid << "bytes";
+        m_file.resize(valid);
+        m_size = valid;
+    }
+    m_file.seek(m_size);
+}
+
+RoomHistory::~RoomHistory() {
+    m_file.close(); // flushes
+}
+
+bool RoomHistory::tail_is_valid() {
+    if (m_size == 0) {
+        return true;
+    }
+    if (m_size < 8) {
+        return false;
+    }
+    quint32 length = read_length(&m_file, m_size - 4);
+    if (length > MAX_RECORD_BYTES || qint64(length) + 8 > m_size) {
+        return false;
+    }
+    return read_length(&m_file, m_size - 8 - length) == length;
+}
+
+qint64 RoomHistory::last_valid_end() {
+    qint64 pos = 0;
+    HistoryRecord record;
+    qint64 next;
+    while (pos < m_size && read_record(&m_file, pos, &record, &next)
+           && next <= m_size
+           && read_length(&m_file, next - 4) == quint32(next - pos - 8)) {
+        pos = next;
+    }
+    return pos;
+}
+
+qint64 RoomHistory::append(const HistoryRecord &record) {
+    if (!m_file.isOpen()) {
+        return -1;
+    }
+    QByteArray data = encode(record);
+    uchar length[4];
+    qToBigEndian<quint32>(data.size(), length);
+    qint64 offset = m_size;
+    m_file.write((const char*)length, 4);
+    m_file.write(data);
+    m_file.write((const char*)length, 4);
+    m_size += data.size() + 8;
+    return offset;
+}
+
+void RoomHistory::flush() {
+    if (m_file.isOpen()) {
+        m_file.flush();
+    }
+}
+
+bool RoomHistory::read_record(QFile *file, const qint64 offset,
+                              HistoryRecord *record, qint64 *next) {
+    quint32 length = read_length(file, offset);
+    if (length == 0 || length > MAX_RECORD_BYTES) {
+        return false;
+    }
+    QByteArray data = file->read(length);
+    if (data.size() != int(length) || !decode(data, record)) {
+        return false;
+    }
+    record->offset = offset;
+    record->next = offset + length + 8;
+    *next = record->next;
+    return true;
+}
+
+QList<HistoryRecord> RoomHistory::read_before(const QString &path,
+                                              const qint64 offset,
+                                              const int count) {
+    QList<HistoryRecord> records;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return records;
+    }
+    qint64 end = offset;
+    while (end >= 8 && records.size() < count) {
+        quint32 length = read_length(&file, end - 4);
+        qint64 start = end - 8 - length;
+        HistoryRecord record;
+        qint64 next;
+        if (length > MAX_RECORD_BYTES || start < 0 ||
+            !read_record(&file, start, &record, &next) || next != end) {
+            qWarning() << "history" << path << "is damaged before" << end;
+            break;
+        }
+        records.prepend(record);
+        end = start;
+    }
+    return records;
+}
+
+QList<HistoryRecord> RoomHistory::read_after(const QString &path,
+                                             const qint64 offset,
+                                             const int count,
+                                             const qint64 end) {
+    QList<HistoryRecord> records;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return records;
+    }
+    qint64 pos = offset;
+    while (pos < end && records.size() < count) {
+        HistoryRecord record;
+        qint64 next;
+        if (!read_record(&file, pos, &record, &next) || next > end) {
+            qWarning() << "history" << path << "is damaged at" << pos;
+            break;
+        }
+        records.append(record);
+        pos = next;
+    }
+    return records;
+}
@@ -0,0 +1,89 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtCore>
+
+#include "room_registry.h"
+#include "talker_room.h"
+
+RoomRegistry::~RoomRegistry() {
+    qDeleteAll(m_rooms);
+}
+
+RoomEntry *RoomRegistry::add(TalkerRoom *room, RoomView *view) {
+    Key key(room->account(), room->id());
+    RoomEntry *entry = m_rooms.value(key);
+    if (!entry) {
+        entry = new RoomEntry;
+        entry->tab = -1;
+        m_rooms.insert(key, entry);
+    }
+    entry->account = room->account();
+    entry->room = room;
+    entry->view = view;
+    return entry;
+}
+
+void RoomRegistry::remove(const TalkerAccount *acct, const int room_id) {
+    RoomEntry *entry = m_rooms.take(qMakePair(acct, room_id));
+    if (!entry) {
+        return;
+    }
+    if (entry->tab != -1) {
+        tab_removed(entry->tab);
+    }
+    delete entry;
+}
+
+RoomEntry *RoomRegistry::find(const TalkerRoom *room) const {
+    return room ? find(room->account(), room->id()) : 0;
+}
+
+void RoomRegistry::tab_inserted(RoomEntry *entry, const int tab) {
+    m_tabs.insert(tab, entry);
+    renumber(tab, m_tabs.size() - 1);
+}
+
+void RoomRegistry::tab_removed(const int tab) {
+    if (tab < 0 || tab >= m_tabs.size()) {
+        return;
+    }
+    m_tabs.at(tab)->tab = -1;
+    m_tabs.remove(tab);
+    renumber(tab, m_tabs.size() - 1);
+}
+
+void RoomRegistry::tab_moved(const int from, const int to) {
+    if (from < 0 || from >= m_tabs.size() || to < 0 || to >= m_tabs.size()) {
+        return;
+    }
+    RoomEntry *entry = m_tabs.at(from);
+    m_tabs.remove(from);
+    m_tabs.insert(to, entry);
+    renumber(qMin(from, to), qMax(from, to));
+}
+
+void RoomRegistry::renumber(const int from, const int to) {
+    for (int i = from; i <= to; ++i) {
+        m_tabs[i]->tab = i;
+    }
+}
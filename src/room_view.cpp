@@ -0,0 +1,899 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtGui>
+
+#include "room_view.h"
+#include "message_item.h"
+#include "text_arena.h"
+#include "chat_delegate.h"
+#include "chat_filter.h"
+#include "settings_store.h"
+#include "talker_account.h"
+#include "talker_user.h"
+
+// rough cost of one chat row's three QStandardItems, not counting the text
+static const qint64 ROW_OVERHEAD_BYTES = 3 * 160;
+
+// records kept for the rows of a hibernated view
+enum FrozenKind {
+    // each record is the kind, user id, highlight flag, history offset and
+    // the fields
+    FrozenMessage = 0, // ISO time, user name, content, event id
+    FrozenAppend = 1, // content, ISO time and event id of a segment
+    FrozenSystem = 2 // ISO time, message
+};
+// set on the content item of rows containing a highlight word
+static const int HighlightRole = Qt::UserRole + 1;
+// uncompressed records are compressed into a chunk at this size
+static const int FROZEN_CHUNK_BYTES = 64 * 1024;
+// rows on each side of the viewport sized along with it
+static const int PREFETCH_ROWS = 20;
+// garbage the text arena may hold before it's compacted, at least
+static const qint64 ARENA_SLACK_BYTES = 1024 * 1024;
+// rows sized in one go by the background relayout
+static const int RELAYOUT_CHUNK_ROWS = 200;
+// history records read at a time while scrolling back
+static const int PAGE_RECORDS = 100;
+// rows kept while paging through history, the rest are dropped
+static const int SCROLLBACK_ROWS = 1000;
+
+RoomView::RoomView(TalkerRoom *room)
+    : QObject(room)
+    , m_room(room)
+    , m_page(new QWidget(0))
+    , m_chat(new QTableView(m_page))
+    , m_delegate(new ChatDelegate(m_chat))
+    , m_model(new QStandardItemModel(this))
+    , m_opts(room->options())
+    , m_latency(room->name(), room->id())
+    , m_model_bytes(0)
+    , m_arena(new TextArena())
+    , m_arena_live(0)
+    , m_last_sender_id(-1)
+    , m_hibernated(false)
+    , m_background(false)
+    , m_filter_bar(new QWidget(m_page))
+    , m_filter_user(new QComboBox(m_filter_bar))
+    , m_filter_text(new QLineEdit(m_filter_bar))
+    , m_filter(new ChatFilter(m_model, this))
+    , m_history(0)
+    , m_history_timer(new QTimer(this))
+    , m_top_offset(0)
+    , m_bottom_offset(0)
+    , m_live(true)
+    , m_page_watcher(new QFutureWatcher<QList<HistoryRecord> >(this))
+    , m_paging_older(true)
+    , m_paging_end(0)
+    , m_generation(0)
+    , m_paging_generation(0)
+    , m_relayout_timer(new QTimer(this))
+    , m_relayout_row(-1)
+    , m_relayout_skip_from(0)
+    , m_relayout_skip_to(-1)
+{
+    // only the app keeps history, not replays or benchmarks
+    if (SettingsStore::instance() && m_opts->history_enabled) {
+        m_history = new RoomHistory(QString("%1/%2_room_%3.hist")
+                                    .arg(m_opts->history_dir)
+                                    .arg(room->account()->domain())
+                                    .arg(room->id()));
+        if (!m_history->is_open()) {
+            delete m_history;
+            m_history = 0;
+        }
+    }
+    m_history_timer->setSingleShot(true);
+    m_history_timer->setInterval(1000);
+    connect(m_history_timer, SIGNAL(timeout()), SLOT(flush_history()));
+    connect(m_page_watcher, SIGNAL(finished()), SLOT(on_page_loaded()));
+
+    m_chat->horizontalHeader()->setStretchLastSection(true);
+    m_chat->horizontalHeader()->show();
+    m_chat->verticalHeader()->hide();
+    m_chat->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_chat->setWordWrap(true);
+    m_chat->setShowGrid(false);
+    m_chat->setAlternatingRowColors(true);
+    m_chat->setIconSize(QSize(24, 24));
+    m_chat->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_chat->setStyleSheet("QTableView {border: 0px;}");
+    m_chat->setModel(m_model);
+    m_chat->setItemDelegateForColumn(2, m_delegate);
+    m_chat->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    m_chat->viewport()->installEventFilter(this); // to see when rows paint
+    clear();
+
+    // the filter bar sits above the table until it's closed
+    QToolButton *close_filter = new QToolButton(m_filter_bar);
+    close_filter->setText(tr("Close"));
+    close_filter->setAutoRaise(true);
+    QHBoxLayout *bar = new QHBoxLayout(m_filter_bar);
+    bar->setContentsMargins(4, 2, 4, 2);
+    bar->addWidget(new QLabel(tr("Show"), m_filter_bar));
+    bar->addWidget(m_filter_user);
+    bar->addWidget(m_filter_text, 1);
+    bar->addWidget(close_filter);
+    QVBoxLayout *page = new QVBoxLayout(m_page);
+    page->setContentsMargins(0, 0, 0, 0);
+    page->setSpacing(0);
+    page->addWidget(m_filter_bar);
+    page->addWidget(m_chat);
+    m_filter_bar->hide();
+    m_filter_text->setToolTip(tr("Messages with words starting with these"));
+    connect(m_filter_user, SIGNAL(currentIndexChanged(int)),
+            SLOT(apply_filter()));
+    connect(m_filter_text, SIGNAL(textChanged(QString)),
+            SLOT(apply_filter()));
+    connect(close_filter, SIGNAL(clicked()), SLOT(hide_filter()));
+    QShortcut *escape = new QShortcut(QKeySequence(Qt::Key_Escape),
+                                      m_filter_bar);
+    escape->setContext(Qt::WidgetWithChildrenShortcut);
+    connect(escape, SIGNAL(activated()), SLOT(hide_filter()));
+
+    m_relayout_timer->setInterval(0);
+    connect(m_relayout_timer, SIGNAL(timeout()), SLOT(continue_relayout()));
+    connect(m_chat->horizontalHeader(), SIGNAL(sectionResized(int,int,int)),
+            SLOT(on_section_resized(int,int,int)));
+    connect(m_chat->verticalScrollBar(), SIGNAL(valueChanged(int)),
+            SLOT(on_scrolled(int)));
+
+    connect(room, SIGNAL(connected(const TalkerRoom*)), SLOT(clear()));
+    connect(room, SIGNAL(message_added(RoomMessage)),
+            SLOT(on_message(RoomMessage)));
+    connect(room, SIGNAL(system_message(QDateTime,QString)),
+            SLOT(on_system_message(QDateTime,QString)));
+    LatencyTracer::add_room(&m_latency);
+}
+
+RoomView::~RoomView() {
+    LatencyTracer::remove_room(&m_latency);
+    m_page_watcher->waitForFinished();
+    delete m_history; // flushes
+    delete m_page; // also takes it out of whatever tab holds it
+    delete m_arena;
+}
+
+void RoomView::clear() {
+    // make our widget ready to rock...
+    m_model->clear();
+    m_model_bytes = 0;
+    m_delegate->clear_cache();
+    reset_arena();
+    m_last_sender_id = -1;
+    m_frozen.clear();
+    m_pending.clear();
+    QStringList labels;
+    labels << tr("Time") << tr("User") << tr("Message");
+    m_model->setHorizontalHeaderLabels(labels);
+    m_chat->setColumnHidden(0, !m_opts->show_timestamps);
+
+    // everything already in the history is scrollback now
+    ++m_generation;
+    m_top_offset = m_bottom_offset = m_history ? m_history->size() : 0;
+    m_live = true;
+}
+
+qint64 RoomView::remember(const HistoryRecord &record) {
+    if (!m_history) {
+        return -1;
+    }
+    qint64 offset = m_history->append(record);
+    if (!m_history_timer->isActive()) {
+        m_history_timer->start();
+    }
+    return offset;
+}
+
+void RoomView::flush_history() {
+    if (m_history) {
+        m_history->flush();
+    }
+}
+
+void RoomView::on_message(const RoomMessage &msg) {
+    MessageTrace trace;
+    trace.event_id = msg.event_id;
+    trace.read = m_room->read_usec();
+    trace.parsed = m_room->parsed_usec();
+
+    HistoryRecord record;
+    record.kind = HistoryRecord::Message;
+    record.time = msg.time;
+    record.user_id = msg.user_id;
+    record.user_name = msg.user_name;
+    record.content = msg.content;
+    record.event_id = msg.event_id;
+    record.highlighted = !msg.highlights.isEmpty();
+    qint64 offset = remember(record);
+
+    // is this another message from the same user who sent the last message?
+    bool append_mode = msg.user_id == m_last_sender_id;
+
+    if (!m_live || m_hibernated) {
+        if (!m_live) {
+            // scrolled back, it shows up with the pages below
+        } else if (append_mode) {
+            // no items and no layout until the tab is shown again
+            freeze(FrozenAppend, QStringList() << msg.content
+                   << msg.time.toString(Qt::ISODate) << msg.event_id, 0,
+                   record.highlighted, offset);
+        } else {
+            freeze(FrozenMessage, QStringList()
+                   << msg.time.toString(Qt::ISODate) << msg.user_name
+                   << msg.content << msg.event_id, msg.user_id,
+                   record.highlighted, offset);
+            m_last_sender_id = msg.user_id;
+        }
+        trace.inserted = LatencyTracer::now_usec();
+        trace.laid_out = trace.painted = trace.inserted;
+        m_latency.add(trace);
+        return;
+    }
+
+    // follow new messages unless scrolled back to read older ones
+    QScrollBar *bar = m_chat->verticalScrollBar();
+    bool at_bottom = bar->value() == bar->maximum();
+    if (append_mode) {
+        append_to_row(msg.time, msg.content, msg.event_id,
+                      record.highlighted);
+    } else {
+        add_message_row(msg.time, msg.user_id, msg.user_name, msg.content,
+                        msg.event_id, record.highlighted, offset);
+    }
+    trace.inserted = LatencyTracer::now_usec();
+    if (m_background) {
+        // the table isn't attached, layout and scrolling wait for relayout()
+        trace.laid_out = trace.painted = trace.inserted;
+        m_latency.add(trace);
+        return;
+    }
+
+    m_chat->resizeColumnToContents(0);
+    m_chat->resizeColumnToContents(1);
+    // only the last row changed, the others keep their heights
+    m_chat->resizeRowToContents(m_chat->model()->rowCount() - 1);
+
+    trace.laid_out = LatencyTracer::now_usec();
+    if (m_chat->isVisible()) {
+        m_unpainted.append(trace); // finished by the next paint of the view
+    } else {
+        trace.painted = trace.laid_out; // nothing to paint for hidden tabs
+        m_latency.add(trace);
+    }
+
+    if (at_bottom) {
+        // the grown row was sized above, so the bottom is where it ends
+        m_chat->scrollToBottom();
+    }
+}
+
+void RoomView::on_system_message(const QDateTime &time,
+                                 const QString &message) {
+    HistoryRecord record;
+    record.kind = HistoryRecord::System;
+    record.time = time;
+    record.content = message;
+    qint64 offset = remember(record);
+
+    if (!m_live) {
+        return; // shows up with the pages below
+    }
+    if (m_hibernated) {
+        freeze(FrozenSystem, QStringList() << time.toString(Qt::ISODate)
+               << message, 0, false, offset);
+        m_last_sender_id = -1;
+    } else {
+        add_system_row(time, message, offset);
+    }
+}
+
+void RoomView::add_message_row(const QDateTime &when, const int user_id,
+                               const QString &user_name,
+                               const QString &content,
+                               const QString &event_id,
+                               const bool highlighted,
+                               const qint64 offset, const int row) {
+    // every row of a sender shares one copy of the name
+    QStandardItem *i_sender = new QStandardItem(
+            m_room->account()->intern_name(user_name));
+    i_sender->setData(user_id, Qt::UserRole);
+    QIcon icon = avatar(m_room->user(user_id));
+    if (!icon.isNull()) {
+        i_sender->setIcon(icon);
+    }
+    MessageItem *i_content = new MessageItem(m_arena, when, content,
+                                             event_id);
+    QStandardItem *i_time = new TimeItem(when, offset);
+    QList<QStandardItem*> items;
+    items << i_time << i_sender << i_content;
+    if (row == -1) {
+        m_model->appendRow(items);
+        m_last_sender_id = user_id;
+    } else {
+        m_model->insertRow(row, items);
+    }
+
+    i_time->setTextAlignment(Qt::AlignLeft | Qt::AlignTop);
+    i_sender->setTextAlignment(Qt::AlignLeft | Qt::AlignTop);
+    i_content->setTextAlignment(Qt::AlignLeft | Qt::AlignTop);
+    m_model_bytes += ROW_OVERHEAD_BYTES;
+    m_arena_live += i_content->arena_bytes();
+    if (highlighted) {
+        highlight_row(i_content->row());
+    }
+}
+
+void RoomView::append_to_row(const QDateTime &time, const QString &content,
+                             const QString &event_id,
+                             const bool highlighted, const int row) {
+    QStandardItem *msg = m_model->item(row == -1 ? m_model->rowCount() - 1
+                                                 : row, 2);
+    if (!msg || msg->type() != MessageItem::Type) {
+        return;
+    }
+    MessageItem *item = static_cast<MessageItem*>(msg);
+    int before = item->arena_bytes();
+    item->append(time, content, event_id);
+    m_arena_live += item->arena_bytes() - before;
+    if (highlighted) {
+        highlight_row(msg->row());
+    }
+}
+
+void RoomView::highlight_row(const int row) {
+    for (int c = 0; c < m_model->columnCount(); ++c) {
+        QStandardItem *item = m_model->item(row, c);
+        if (item) {
+            item->setBackground(QBrush(QColor(255, 243, 176)));
+        }
+    }
+    m_model->item(row, 2)->setData(true, HighlightRole);
+}
+
+void RoomView::add_system_row(const QDateTime &when, const QString &message,
+                              const qint64 offset, const int row) {
+    QStandardItem *i_time = new TimeItem(when, offset);
+    QStandardItem *i_icon = new QStandardItem(
+            QIcon(":img/icons/information.png"), "");
+    QStandardItem *i_msg = new QStandardItem(message);
+    i_time->setForeground(QBrush(Qt::gray));
+    i_msg->setForeground(QBrush(Qt::gray));
+    QList<QStandardItem*> items;
+    items << i_time << i_icon << i_msg;
+    if (row == -1) {
+        m_model->appendRow(items);
+        m_last_sender_id = -1;
+    } else {
+        m_model->insertRow(row, items);
+    }
+    m_model_bytes += ROW_OVERHEAD_BYTES + sizeof(QChar) * message.size();
+}
+
+qint64 RoomView::row_bytes(const int row) const {
+    QStandardItem *item = m_model->item(row, 2);
+    if (item && item->type() != MessageItem::Type) {
+        // system rows keep their text in the item
+        return ROW_OVERHEAD_BYTES + sizeof(QChar) * item->text().size();
+    }
+    return ROW_OVERHEAD_BYTES;
+}
+
+qint64 RoomView::row_offset(const int row) const {
+    QStandardItem *item = m_model->item(row, 0);
+    if (!item || item->type() != TimeItem::Type) {
+        return -1;
+    }
+    return static_cast<TimeItem*>(item)->offset();
+}
+
+void RoomView::remove_rows(const int row, const int count) {
+    for (int r = row; r < row + count; ++r) {
+        m_model_bytes -= row_bytes(r);
+        QStandardItem *item = m_model->item(r, 2);
+        if (item && item->type() == MessageItem::Type) {
+            MessageItem *msg = static_cast<MessageItem*>(item);
+            m_arena_live -= msg->arena_bytes();
+            m_delegate->forget(msg->serial());
+        }
+    }
+    m_model_bytes = qMax(m_model_bytes, qint64(0));
+    m_model->removeRows(row, count);
+
+    // the arena only grows, copy what's left once it's mostly garbage
+    qint64 garbage = m_arena->used() - m_arena_live;
+    if (garbage > qMax(m_arena_live, ARENA_SLACK_BYTES)) {
+        TextArena *arena = new TextArena();
+        for (int r = 0; r < m_model->rowCount(); ++r) {
+            QStandardItem *item = m_model->item(r, 2);
+            if (item && item->type() == MessageItem::Type) {
+                static_cast<MessageItem*>(item)->move_to(arena);
+            }
+        }
+        delete m_arena;
+        m_arena = arena;
+    }
+}
+
+void RoomView::reset_arena() {
+    delete m_arena;
+    m_arena = new TextArena();
+    m_arena_live = 0;
+}
+
+void RoomView::freeze(const int kind, const QStringList &fields,
+                      const int user_id, const bool highlighted,
+                      const qint64 offset) {
+    QDataStream out(&m_pending, QIODevice::WriteOnly | QIODevice::Append);
+    out << quint8(kind) << qint32(user_id) << highlighted << offset << fields;
+    if (m_pending.size() >= FROZEN_CHUNK_BYTES) {
+        m_frozen.append(qCompress(m_pending));
+        m_pending.clear();
+    }
+}
+
+void RoomView::finish_traces() {
+    qint64 now = LatencyTracer::now_usec();
+    foreach(MessageTrace trace, m_unpainted) {
+        trace.painted = now;
+        m_latency.add(trace);
+    }
+    m_unpainted.clear();
+}
+
+void RoomView::relayout() {
+    if (m_filter->is_active()) {
+        m_chat->setModel(m_filter);
+    } else {
+        m_chat->setModel(m_model);
+    }
+    m_chat->setColumnHidden(0, !m_opts->show_timestamps);
+    m_chat->resizeColumnToContents(0);
+    m_chat->resizeColumnToContents(1);
+    m_chat->scrollToBottom();
+    start_relayout();
+    maybe_load_page(); // a short chat never scrolls, fill it from history
+}
+
+void RoomView::start_relayout() {
+    // the table may be showing the filter, its rows are the ones to size
+    QAbstractItemModel *model = m_chat->model();
+    int rows = model ? model->rowCount() : 0;
+    if (!rows) {
+        m_relayout_timer->stop();
+        return;
+    }
+    QScrollBar *bar = m_chat->verticalScrollBar();
+    bool at_bottom = bar->value() == bar->maximum();
+    int first = m_chat->rowAt(0);
+    int last = m_chat->rowAt(m_chat->viewport()->height() - 1);
+    first = qMax((first == -1 ? 0 : first) - PREFETCH_ROWS, 0);
+    last = qMin((last == -1 ? rows - 1 : last) + PREFETCH_ROWS, rows - 1);
+    for (int r = first; r <= last; ++r) {
+        m_chat->resizeRowToContents(r);
+    }
+    if (at_bottom) {
+        m_chat->scrollToBottom();
+    }
+    // the chat is read from the bottom, so work up from there
+    m_relayout_skip_from = first;
+    m_relayout_skip_to = last;
+    m_relayout_row = rows - 1;
+    m_relayout_timer->start();
+}
+
+void RoomView::continue_relayout() {
+    if (!m_chat->model()) {
+        m_relayout_timer->stop(); // hibernated or in the background
+        return;
+    }
+    m_relayout_row = qMin(m_relayout_row, m_chat->model()->rowCount() - 1);
+    QScrollBar *bar = m_chat->verticalScrollBar();
+    bool at_bottom = bar->value() == bar->maximum();
+    // keep the row at the top of the viewport where it is on screen
+    int anchor = m_chat->rowAt(0);
+    int anchor_y = anchor == -1 ? 0 : m_chat->rowViewportPosition(anchor);
+
+    int sized = 0;
+    while (m_relayout_row >= 0 && sized < RELAYOUT_CHUNK_ROWS) {
+        if (m_relayout_row < m_relayout_skip_from ||
+            m_relayout_row > m_relayout_skip_to) {
+            m_chat->resizeRowToContents(m_relayout_row);
+            ++sized;
+        }
+        --m_relayout_row;
+    }
+
+    if (at_bottom) {
+        m_chat->scrollToBottom();
+    } else if (anchor != -1) {
+        bar->setValue(bar->value() + m_chat->rowViewportPosition(anchor) -
+                      anchor_y);
+    }
+    if (m_relayout_row < 0) {
+        m_relayout_timer->stop();
+    }
+}
+
+void RoomView::on_section_resized(int column, int old_width, int new_width) {
+    Q_UNUSED(old_width);
+    Q_UNUSED(new_width);
+    if (column == 2 && !m_hibernated && !m_background) {
+        start_relayout(); // the text wraps differently at the new width
+    }
+}
+
+void RoomView::show_filter() {
+    if (m_filter_bar->isHidden()) {
+        m_filter->start();
+        // the people who wrote the rows in the table, as of now
+        m_filter_user->blockSignals(true);
+        m_filter_user->clear();
+        m_filter_user->addItem(tr("Everyone"), -1);
+        QMap<QString, int> senders = m_filter->senders();
+        QMap<QString, int>::const_iterator it = senders.constBegin();
+        for (; it != senders.constEnd(); ++it) {
+            m_filter_user->addItem(it.key(), it.value());
+        }
+        m_filter_user->blockSignals(false);
+        m_filter_bar->show();
+    }
+    m_filter_text->setFocus();
+    m_filter_text->selectAll();
+}
+
+void RoomView::hide_filter() {
+    m_filter_bar->hide();
+    m_filter_text->blockSignals(true);
+    m_filter_text->clear();
+    m_filter_text->blockSignals(false);
+    bool filtered = m_chat->model() == m_filter;
+    m_filter->stop();
+    if (filtered) {
+        relayout(); // the whole table again
+    }
+    m_chat->setFocus();
+}
+
+void RoomView::apply_filter() {
+    bool was_active = m_filter->is_active();
+    m_filter->set_query(
+            m_filter_user->itemData(m_filter_user->currentIndex()).toInt(),
+            m_filter_text->text());
+    if (!m_chat->model()) {
+        return; // relayout() picks the right model when the table is back
+    }
+    if (m_filter->is_active() != was_active) {
+        relayout(); // switches between the filter and the whole table
+    } else {
+        m_chat->scrollToBottom();
+        start_relayout(); // other rows are showing, size them
+    }
+}
+
+void RoomView::on_scrolled(int value) {
+    Q_UNUSED(value);
+    maybe_load_page();
+}
+
+void RoomView::maybe_load_page() {
+    if (!m_history || m_chat->model() != m_model ||
+        m_page_watcher->isRunning()) {
+        return;
+    }
+    QScrollBar *bar = m_chat->verticalScrollBar();
+    int margin = m_chat->viewport()->height();
+    if (bar->value() <= margin && m_top_offset > 0) {
+        load_page(true);
+    } else if (!m_live && bar->value() >= bar->maximum() - margin) {
+        load_page(false);
+    }
+}
+
+void RoomView::load_page(const bool older) {
+    m_history->flush(); // the worker reads the file on its own
+    m_paging_older = older;
+    m_paging_generation = m_generation;
+    m_paging_end = m_history->size();
+    if (older) {
+        m_page_watcher->setFuture(QtConcurrent::run(
+                &RoomHistory::read_before, m_history->path(), m_top_offset,
+                PAGE_RECORDS));
+    } else {
+        m_page_watcher->setFuture(QtConcurrent::run(
+                &RoomHistory::read_after, m_history->path(), m_bottom_offset,
+                PAGE_RECORDS, m_paging_end));
+    }
+}
+
+void RoomView::on_page_loaded() {
+    QList<HistoryRecord> records = m_page_watcher->result();
+    if (m_paging_generation != m_generation || m_chat->model() != m_model) {
+        return; // cleared or put away meanwhile, ask again later
+    }
+    QScrollBar *bar = m_chat->verticalScrollBar();
+    // keep the row at the top of the viewport where it is on screen
+    int anchor = m_chat->rowAt(0);
+    int anchor_y = anchor == -1 ? 0 : m_chat->rowViewportPosition(anchor);
+
+    if (m_paging_older) {
+        if (records.isEmpty()) {
+            m_top_offset = 0; // nothing readable before this point
+            return;
+        }
+        // consecutive messages of one sender share a row, as they did live
+        int row = 0;
+        int last_sender = -1;
+        foreach(const HistoryRecord &r, records) {
+            if (r.kind == HistoryRecord::System) {
+                add_system_row(r.time, r.content, r.offset, row++);
+                last_sender = -1;
+            } else if (r.user_id == last_sender) {
+                append_to_row(r.time, r.content, r.event_id, r.highlighted,
+                              row - 1);
+            } else {
+                add_message_row(r.time, r.user_id, r.user_name, r.content,
+                                r.event_id, r.highlighted, r.offset, row++);
+                last_sender = r.user_id;
+            }
+        }
+        m_top_offset = records.first().offset;
+        for (int r = 0; r < row; ++r) {
+            m_chat->resizeRowToContents(r);
+        }
+        if (anchor != -1) {
+            anchor += row;
+        }
+
+        // drop rows well below the viewport, they are paged back in later
+        int last_visible = m_chat->rowAt(m_chat->viewport()->height() - 1);
+        int keep = qMax(SCROLLBACK_ROWS, last_visible + PREFETCH_ROWS + 1);
+        if (last_visible != -1 && keep < m_model->rowCount()) {
+            m_bottom_offset = row_offset(keep);
+            m_live = false;
+            remove_rows(keep, m_model->rowCount() - keep);
+            QStandardItem *sender = m_model->item(keep - 1, 1);
+            QVariant id = sender ? sender->data(Qt::UserRole) : QVariant();
+            m_last_sender_id = id.isValid() ? id.toInt() : -1;
+        }
+    } else {
+        int first_new = m_model->rowCount();
+        foreach(const HistoryRecord &r, records) {
+            if (r.kind == HistoryRecord::System) {
+                add_system_row(r.time, r.content, r.offset);
+            } else if (r.user_id == m_last_sender_id) {
+                append_to_row(r.time, r.content, r.event_id, r.highlighted);
+            } else {
+                add_message_row(r.time, r.user_id, r.user_name, r.content,
+                                r.event_id, r.highlighted, r.offset);
+            }
+        }
+        // an empty page means the rest can't be read, don't ask forever
+        m_bottom_offset = records.isEmpty() ? m_history->size()
+                                            : records.last().next;
+        m_live = m_bottom_offset >= m_history->size();
+        for (int r = qMax(first_new - 1, 0); r < m_model->rowCount(); ++r) {
+            m_chat->resizeRowToContents(r);
+        }
+
+        // drop rows well above the viewport, they are paged back in later
+        int first_visible = m_chat->rowAt(0);
+        int cut = qMin(m_model->rowCount() - SCROLLBACK_ROWS,
+                       first_visible - PREFETCH_ROWS);
+        if (first_visible != -1 && cut > 0) {
+            remove_rows(0, cut);
+            m_top_offset = row_offset(0);
+            anchor -= cut;
+        }
+    }
+
+    if (anchor >= 0 && anchor < m_model->rowCount()) {
+        bar->setValue(bar->value() + m_chat->rowViewportPosition(anchor) -
+                      anchor_y);
+    }
+    maybe_load_page(); // still close to an edge
+}
+
+void RoomView::set_background(const bool background) {
+    if (m_background == background) {
+        return;
+    }
+    m_background = background;
+    if (m_hibernated) {
+        return; // already detached, wake() relays out
+    }
+    if (background) {
+        finish_traces();
+        m_chat->setModel(0);
+    } else {
+        relayout();
+    }
+}
+
+void RoomView::hibernate() {
+    if (m_hibernated) {
+        return;
+    }
+    finish_traces();
+    m_hibernated = true;
+    for (int r = 0; r < m_model->rowCount(); ++r) {
+        QStandardItem *i_time = m_model->item(r, 0);
+        QStandardItem *i_sender = m_model->item(r, 1);
+        QStandardItem *i_content = m_model->item(r, 2);
+        QVariant user_id = i_sender->data(Qt::UserRole);
+        TimeItem *time = static_cast<TimeItem*>(i_time);
+        if (i_content->type() == MessageItem::Type) {
+            // the first segment makes the row, the rest are appended to it
+            bool highlighted = i_content->data(HighlightRole).toBool();
+            MessageItem *msg = static_cast<MessageItem*>(i_content);
+            for (int s = 0; s < msg->segment_count(); ++s) {
+                QString iso = msg->time(s).toString(Qt::ISODate);
+                if (s == 0) {
+                    freeze(FrozenMessage, QStringList() << iso
+                           << i_sender->text() << msg->text(s)
+                           << msg->event_id(s), user_id.toInt(),
+                           highlighted, time->offset());
+                } else {
+                    freeze(FrozenAppend, QStringList() << msg->text(s)
+                           << iso << msg->event_id(s));
+                }
+            }
+        } else {
+            freeze(FrozenSystem, QStringList()
+                   << time->time().toString(Qt::ISODate)
+                   << i_content->text(), 0, false, time->offset());
+        }
+    }
+    // detach the view first so it doesn't hear about every removed row
+    m_chat->setModel(0);
+    m_model->removeRows(0, m_model->rowCount());
+    m_model_bytes = 0;
+    m_delegate->clear_cache(); // the rows come back with new serials
+    reset_arena();
+}
+
+void RoomView::wake() {
+    if (!m_hibernated) {
+        return;
+    }
+    m_hibernated = false;
+    if (!m_pending.isEmpty()) {
+        m_frozen.append(qCompress(m_pending));
+        m_pending.clear();
+    }
+    // rows are added while no table is attached, then laid out in one go
+    foreach(QByteArray chunk, m_frozen) {
+        QByteArray records = qUncompress(chunk);
+        QDataStream in(records);
+        while (!in.atEnd()) {
+            quint8 kind;
+            qint32 user_id;
+            bool highlighted;
+            qint64 offset;
+            QStringList f;
+            in >> kind >> user_id >> highlighted >> offset >> f;
+            if (kind == FrozenMessage && f.size() == 4) {
+                add_message_row(QDateTime::fromString(f.at(0), Qt::ISODate),
+                                user_id, f.at(1), f.at(2), f.at(3),
+                                highlighted, offset);
+            } else if (kind == FrozenAppend && f.size() == 3) {
+                append_to_row(QDateTime::fromString(f.at(1), Qt::ISODate),
+                              f.at(0), f.at(2), highlighted);
+            } else if (kind == FrozenSystem && f.size() == 2) {
+                add_system_row(QDateTime::fromString(f.at(0), Qt::ISODate),
+                               f.at(1), offset);
+            }
+        }
+    }
+    m_frozen.clear();
+
+    if (!m_background) {
+        relayout();
+    }
+}
+
+void RoomView::on_options_changed(OptionsPtr opts) {
+    m_opts = opts;
+    m_chat->setColumnHidden(0, !m_opts->show_timestamps);
+}
+
+bool RoomView::eventFilter(QObject *obj, QEvent *e) {
+    if (e->type() == QEvent::Paint && !m_unpainted.isEmpty()) {
+        qint64 now = LatencyTracer::now_usec();
+        foreach(MessageTrace trace, m_unpainted) {
+            trace.painted = now;
+            m_latency.add(trace);
+        }
+        m_unpainted.clear();
+    }
+    return QObject::eventFilter(obj, e);
+}
+
+MemoryUsage RoomView::memory_usage() const {
+    MemoryUsage usage;
+    usage.model_rows = m_model->rowCount();
+    usage.model_bytes = m_model_bytes + m_arena->bytes() + m_pending.size();
+    foreach(QByteArray chunk, m_frozen) {
+        usage.model_bytes += chunk.size();
+    }
+    return usage;
+}
+
+void RoomView::trim_caches() {
+    if (m_hibernated) {
+        return; // rows are trimmed once the tab is shown again
+    }
+    // drop the oldest rows past the configured limit, they stay in the
+    // history for scrolling back
+    int limit = m_opts->total_messages_per_room;
+    int extra = m_model->rowCount() - limit;
+    if (limit > 0 && extra > 0) {
+        remove_rows(0, extra);
+        m_top_offset = m_history ? row_offset(0) : 0;
+    }
+}
+
+TranscriptExport *RoomView::export_transcript(const QString &path) {
+    if (m_history) {
+        m_history->flush(); // the export reads the file on its own
+        return new TranscriptExport(m_room->name(), m_history->path(),
+                                    m_history->size(), path);
+    }
+    // no history, the rows in the table are all there is
+    QList<HistoryRecord> records;
+    for (int r = 0; r < m_model->rowCount(); ++r) {
+        QStandardItem *i_time = m_model->item(r, 0);
+        QStandardItem *i_sender = m_model->item(r, 1);
+        QStandardItem *i_content = m_model->item(r, 2);
+        HistoryRecord record;
+        if (i_content->type() != MessageItem::Type) {
+            record.kind = HistoryRecord::System;
+            record.time = static_cast<TimeItem*>(i_time)->time();
+            record.content = i_content->text();
+            records.append(record);
+            continue;
+        }
+        record.user_id = i_sender->data(Qt::UserRole).toInt();
+        record.user_name = i_sender->text();
+        MessageItem *msg = static_cast<MessageItem*>(i_content);
+        for (int s = 0; s < msg->segment_count(); ++s) {
+            record.time = msg->time(s);
+            record.content = msg->text(s);
+            record.event_id = msg->event_id(s);
+            records.append(record);
+        }
+    }
+    return new TranscriptExport(m_room->name(), records, path);
+}
+
+QIcon RoomView::avatar(const TalkerUser *user) {
+    if (!user || user->avatar_data.isEmpty()) {
+        return QIcon();
+    }
+    QString key = QString("avatar:%1").arg(user->email);
+    QPixmap pm;
+    if (!QPixmapCache::find(key, &pm)) {
+        pm.loadFromData(user->avatar_data);
+        QPixmapCache::insert(key, pm);
+    }
+    return QIcon(pm);
+}
@@ -0,0 +1,169 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtCore>
+#include <QtConcurrentRun>
+
+#include "settings_store.h"
+
+// how long to wait for more changes before writing the settings file
+static const int WRITE_DELAY_MS = 2000;
+
+SettingsStore *SettingsStore::s_instance = 0;
+
+/**
+  * Runs on a worker thread. QSettings objects are reentrant, so a private
+  * one pointed at the same file can safely write alongside the main one.
+  */
+static void write_values(const QString &file_name,
+                         const QHash<QString, QVariant> &values) {
+    QSettings s(file_name, QSettings::IniFormat);
+    QHashIterator<QString, QVariant> it(values);
+    while (it.hasNext()) {
+        it.next();
+        s.setValue(it.key(), it.value());
+    }
+    s.sync(); // a single write for the whole batch
+}
+
+Options::Options()
+    : show_timestamps(true)
+    , flash_when_not_active(true)
+    , reopen_last_session_rooms(true)
+    , total_messages_per_room(0)
+    , sound_message_received(QString())
+    , highlights(new HighlightMatcher())
+    , server_host("talkerapp.com")
+    , server_port(8500)
+    , rooms_url("https://%1.talkerapp.com/rooms.json")
+    , ignore_ssl_errors(false)
+    , record_traffic(false)
+    , capture_dir(QString())
+    , metrics_enabled(false)
+    , metrics_port(9464)
+    , history_enabled(true)
+    , history_dir(QString())
+{}
+
+void Options::load(QSettings *s) {
+    s->beginGroup("options");
+    show_timestamps = s->value("show_timestamps", true).toBool();
+    flash_when_not_active = s->value("flash_when_not_active", true).toBool();
+    reopen_last_session_rooms = s->value("reopen_last_session_rooms",
+                                         true).toBool();
+    total_messages_per_room = s->value("total_messages_per_room", 0).toInt();
+    sound_message_received = s->value("sound_files/message_received",
+                                      QString()).toString();
+    highlights = QSharedPointer<const HighlightMatcher>(new HighlightMatcher(
+            s->value("highlight_patterns").toStringList()));
+    s->endGroup();
+
+    s->beginGroup("connection");
+    server_host = s->value("host", server_host).toString();
+    server_port = s->value("port", server_port).toUInt();
+    rooms_url = s->value("rooms_url", rooms_url).toString();
+    ignore_ssl_errors = s->value("ignore_ssl_errors", false).toBool();
+    s->endGroup();
+
+    s->beginGroup("diagnostics");
+    record_traffic = s->value("record_traffic", false).toBool();
+    capture_dir = s->value("capture_dir", QFileInfo(s->fileName())
+                           .absolutePath() + "/captures").toString();
+    s->endGroup();
+
+    s->beginGroup("metrics");
+    metrics_enabled = s->value("enabled", false).toBool();
+    metrics_port = s->value("port", metrics_port).toUInt();
+    s->endGroup();
+
+    s->beginGroup("history");
+    history_enabled = s->value("enabled", true).toBool();
+    history_dir = s->value("dir", QFileInfo(s->fileName())
+                           .absolutePath() + "/history").toString();
+    s->endGroup();
+}
+
+SettingsStore::SettingsStore(QObject *parent)
+    : QObject(parent)
+    , m_settings(new QSettings(QSettings::IniFormat, QSettings::UserScope,
+                               QCoreApplication::organizationName(),
+                               QCoreApplication::applicationName(), this))
+    , m_timer(new QTimer(this))
+{
+    s_instance = this;
+    m_timer->setSingleShot(true);
+    m_timer->setInterval(WRITE_DELAY_MS);
+    connect(m_timer, SIGNAL(timeout()), SLOT(write_pending()));
+    reload_options();
+}
+
+SettingsStore::~SettingsStore() {
+    flush();
+    if (s_instance == this) {
+        s_instance = 0;
+    }
+}
+
+QVariant SettingsStore::value(const QString &key,
+                              const QVariant &default_value) const {
+    if (m_values.contains(key)) {
+        return m_values.value(key);
+    }
+    return m_settings->value(key, default_value);
+}
+
+void SettingsStore::set_value(const QString &key, const QVariant &value) {
+    m_values.insert(key, value);
+    m_pending.insert(key, value);
+    if (!m_timer->isActive()) {
+        m_timer->start();
+    }
+}
+
+void SettingsStore::flush() {
+    m_timer->stop();
+    m_write.waitForFinished();
+    if (!m_pending.isEmpty()) {
+        write_values(m_settings->fileName(), m_pending);
+        m_pending.clear();
+    }
+}
+
+void SettingsStore::reload_options() {
+    Options *opts = new Options();
+    opts->load(m_settings);
+    m_options = OptionsPtr(opts);
+    emit options_changed(m_options);
+}
+
+void SettingsStore::write_pending() {
+    if (m_pending.isEmpty()) {
+        return;
+    }
+    if (m_write.isRunning()) {
+        m_timer->start(); // try again once the last batch is on disk
+        return;
+    }
+    m_write = QtConcurrent::run(write_values, m_settings->fileName(),
+                                m_pending);
+    m_pending.clear();
+}
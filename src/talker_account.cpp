@@ -25,7 +25,7 @@ THE SOFTWARE.
 
 #include "talker_account.h"
 #include "talker_room.h"
-#include "ui_account_edit_dialog.h"
+#include "settings_store.h"
 
 TalkerAccount::TalkerAccount(const QString &name, const QString &token,
                              const QString &domain, QObject *parent)
@@ -36,9 +36,11 @@ TalkerAccount::TalkerAccount(const QString &name, const QString &token,
     , m_last_used(QDateTime::currentDateTime())
     , m_open_rooms(QMap<QString, QVariant>())
     , m_avail_rooms(QMap<QString, int>())
-    , m_active_rooms(QList<TalkerRoom*>())
-    , m_net(new QNetworkAccessManager(this))
+    , m_active_rooms(QHash<int, TalkerRoom*>())
+    , m_net(0)
     , m_engine(new QScriptEngine(this))
+    , m_rooms_restored(false)
+    , m_fetch_avatars(true)
 {}
 
 TalkerAccount::~TalkerAccount() {
@@ -52,6 +54,16 @@ void TalkerAccount::load_settings(QSettings &s) {
     m_open_rooms = s.value("open_rooms").toMap();
 }
 
+void TalkerAccount::set_network(QNetworkAccessManager *net) {
+    m_net = net;
+}
+
+void TalkerAccount::setup_network() {
+    if (!m_net) { // nobody gave us a shared manager, make our own
+        m_net = new QNetworkAccessManager(this);
+    }
+}
+
 void TalkerAccount::set_name(const QString &name) {
     m_name = name;
     emit settings_changed(*this);
@@ -83,14 +95,45 @@ void TalkerAccount::logout() {
 }
 
 void TalkerAccount::get_available_rooms() {
+    // start joining from the last list we saw so we don't have to wait for
+    // the server, the request below will tell us if anything changed
+    SettingsStore *store = SettingsStore::instance();
+    QString group = QString("rooms_cache_%1/").arg(m_domain);
+    QString cached = store->value(group + "body").toString();
+    QByteArray etag = store->value(group + "etag").toByteArray();
+    QByteArray last_modified = store->value(group + "last_modified")
+                               .toByteArray();
+
+    m_rooms_restored = false;
+    QMap<QString, int> rooms;
+    if (!cached.isEmpty() && parse_rooms(cached, rooms)) {
+        set_avail_rooms(rooms);
+        restore_rooms();
+        emit new_rooms_available(*this);
+    } else {
+        // no usable cache, make sure the server sends us a full list
+        etag.clear();
+        last_modified.clear();
+    }
+
     // get rooms...
-    QUrl url(QString("https://%1.talkerapp.com/rooms.json").arg(m_domain));
+    QString rooms_url = store->options()->rooms_url;
+    if (rooms_url.contains("%1")) {
+        rooms_url = rooms_url.arg(m_domain);
+    }
+    QUrl url(rooms_url);
 
     QNetworkRequest req(url);
     req.setRawHeader(QByteArray("Accept"), QByteArray("application/json"));
     req.setHeader(QNetworkRequest::ContentTypeHeader,
                   QByteArray("application/json"));
     req.setRawHeader(QByteArray("X-Talker-Token"), m_token.toAscii());
+    if (!etag.isEmpty()) {
+        req.setRawHeader(QByteArray("If-None-Match"), etag);
+    }
+    if (!last_modified.isEmpty()) {
+        req.setRawHeader(QByteArray("If-Modified-Since"), last_modified);
+    }
 
     /*
     qDebug() << "sending request" << req.url();
@@ -98,168 +141,211 @@ void TalkerAccount::get_available_rooms() {
         qDebug() << "HEADER:" << hdr << ":" << req.rawHeader(hdr);
     }
     */
-    connect(m_net, SIGNAL(finished(QNetworkReply*)),
-            SLOT(rooms_request_finished(QNetworkReply*)));
-    m_net->get(req);
+    // listen on the reply itself, the manager may be shared with other
+    // accounts whose requests are in flight at the same time
+    setup_network();
+    QNetworkReply *r = m_net->get(req);
+    connect(r, SIGNAL(finished()), SLOT(rooms_request_finished()));
+    connect(r, SIGNAL(sslErrors(QList<QSslError>)),
+            SLOT(rooms_ssl_errors(QList<QSslError>)));
 }
 
-void TalkerAccount::rooms_request_finished(QNetworkReply *r) {
-    m_net->disconnect(this, SLOT(rooms_request_finished(QNetworkReply*)));
-    QString reply(r->readAll());
+void TalkerAccount::rooms_ssl_errors(const QList<QSslError> &errors) {
+    qWarning() << "\tSSL ERROR:" << errors;
+    QNetworkReply *r = qobject_cast<QNetworkReply*>(QObject::sender());
+    if (r && SettingsStore::instance()->options()->ignore_ssl_errors) {
+        r->ignoreSslErrors(); // e.g. a local test server
+    }
+}
+
+bool TalkerAccount::parse_rooms(const QString &reply,
+                                QMap<QString, int> &rooms) {
     // looks something like this...
     // [{"name": "Main", "id": 497}, {"name": "Second Room", "id": 512}]
+    QScriptValue val = m_engine->evaluate(QString("(%1)").arg(reply));
+    if (m_engine->hasUncaughtException() || !val.isArray()) {
+        return false;
+    }
+    int total = val.property("length").toInt32();
+    for (int i = 0; i < total; ++i) {
+        QScriptValue room = val.property(i);
+        rooms.insert(room.property("name").toString(),
+                     room.property("id").toInteger());
+    }
+    return true;
+}
+
+void TalkerAccount::set_avail_rooms(const QMap<QString, int> &rooms) {
+    m_avail_rooms = rooms;
+    m_room_names.clear();
+    QMapIterator<QString, int> it(rooms);
+    while (it.hasNext()) {
+        it.next();
+        m_room_names.insert(it.value(), it.key());
+    }
+}
+
+void TalkerAccount::restore_rooms() {
+    bool auto_join = SettingsStore::instance()->options()
+                     ->reopen_last_session_rooms;
+
+    if (m_open_rooms.size() < 1) { // never opened any rooms here?
+        if (m_rooms_restored) {
+            return; // we already asked once this session
+        }
+        m_rooms_restored = true;
+        emit choose_rooms(*this);
+    } else {
+        m_rooms_restored = true;
+        // restore all open rooms if they still exist...
+        if (auto_join) {
+            foreach(QString name, m_open_rooms.keys()) {
+                if (m_avail_rooms.contains(name) &&
+                    m_avail_rooms[name] == m_open_rooms[name].toInt()) {
+                    open_room(m_avail_rooms[name]); // no-op if already open
+                }
+            }
+        }
+    }
+}
+
+void TalkerAccount::rooms_request_finished() {
+    QNetworkReply *r = qobject_cast<QNetworkReply*>(QObject::sender());
+    if (!r) {
+        qWarning() << "ERROR: room list request completed, but we lost the "
+                << "response";
+        return;
+    }
+    r->deleteLater();
+    int status = r->attribute(QNetworkRequest::HttpStatusCodeAttribute)
+                 .toInt();
+    if (r->error() == QNetworkReply::NoError && status == 304) {
+        // the cached list we already restored from is still current
+        emit new_status_message(tr("%1: room list is up to date")
+                                .arg(m_name));
+        return;
+    }
+    QString reply(r->readAll());
 
     if (r->error() == QNetworkReply::NoError) { // YAY!
+        QMap<QString, int> rooms;
+        if (parse_rooms(reply, rooms)) {
+            // close any open rooms that went away since we cached the list
+            foreach(TalkerRoom *room, m_active_rooms) {
+                if (rooms.value(room->name(), -1) != room->id()) {
+                    qDebug() << "room" << room->name() << "no longer exists";
+                    close_room(room->id());
+                }
+            }
+            set_avail_rooms(rooms);
+            restore_rooms(); // joins rooms the cache didn't know about yet
+            emit new_rooms_available(*this);
+
+            SettingsStore *store = SettingsStore::instance();
+            QString group = QString("rooms_cache_%1/").arg(m_domain);
+            store->set_value(group + "body", reply);
+            store->set_value(group + "etag", r->rawHeader("ETag"));
+            store->set_value(group + "last_modified",
+                             r->rawHeader("Last-Modified"));
+            return;
+        }
+
         QScriptValue val = m_engine->evaluate(QString("(%1)").arg(reply));
         if (m_engine->hasUncaughtException()) {
             qWarning() << "SCRIPT EXCEPTION"
                     << m_engine->uncaughtException().toString();
-            QMessageBox::warning(
-                NULL, tr("Communication Error!"),
-                tr("Failed to parse response from server:\n\n%1").arg(reply));
+            emit error(tr("Communication Error!"),
+                       tr("Failed to parse response from server:\n\n%1")
+                       .arg(reply));
             return;
         }
         //qDebug() << "Evaluated response:" << val.toString();
         QString response_type = val.property("type").toString();
 
-        if (val.isArray()) {
-            QScriptValueIterator it(val);
-            while(it.hasNext()) {
-                it.next();
-                QScriptValue room = it.value();
-                QString room_name = room.property("name").toString();
-                int room_id = room.property("id").toInteger();
-                m_avail_rooms.insert(room_name, room_id);
-            }
-
-            QSettings *s = new QSettings(QSettings::IniFormat,
-                                         QSettings::UserScope,
-                                         QApplication::organizationName(),
-                                         QApplication::applicationName(),
-                                         this);
-            bool auto_join = s->value("options/reopen_last_session_rooms",
-                                      true).toBool();
-
-            if (m_open_rooms.size() < 1) { // never opened any rooms here?
-                QString to_join = QInputDialog::getItem(
-                        NULL, tr("Choose which room to join"),
-                        tr("Select a room"), m_avail_rooms.keys(), 0, false);
-                if (!to_join.isEmpty()) {
-                    open_room(m_avail_rooms[to_join]);
-                }
-            } else {
-                // restore all open rooms if they still exist...
-                if (auto_join) {
-                    foreach(QString name, m_open_rooms.keys()) {
-                        if (m_avail_rooms.contains(name) &&
-                            m_avail_rooms[name] == m_open_rooms[name].toInt()) {
-                            open_room(m_avail_rooms[name]);
-                        }
-                    }
-                }
-            }
-            emit new_rooms_available(*this);
-        } else if (val.isObject() && response_type == "error") {
+        if (val.isObject() && response_type == "error") {
             QString msg = val.property("message").toString();
             qWarning() << "SERVER SENT ERROR:" << msg;
             if (msg == "Please login") {
-                int want_to_edit = QMessageBox::question(
-                        NULL, tr("Unauthorized Login"),
-                        tr("The credentials you supplied for account '%1' are "
-                           "invalid. Would you like to edit this account?")
-                        .arg(m_name),
-                        QMessageBox::Yes, QMessageBox::No
-                );
-                if (want_to_edit == QMessageBox::Yes && edit()) {
-                    // try again
-                    get_available_rooms();
-                }
+                emit login_failed(*this);
             } else {
-                QMessageBox::warning(
-                        NULL, tr("Server Error!"),
-                        tr("Server sent the following error:\n\n%1").arg(msg)
-                );
+                emit error(tr("Server Error!"),
+                           tr("Server sent the following error:\n\n%1")
+                           .arg(msg));
             }
         }
     } else {
         qWarning() << "ROOM REQUEST ERROR:" << r->errorString() << r->error();
-        QMessageBox::warning(
-                NULL, tr("Server Error!"),
-                tr("There was an error retreiving the room list:\n\n%1")
-                .arg(r->errorString())
-        );
+        emit error(tr("Server Error!"),
+                   tr("There was an error retreiving the room list:\n\n%1")
+                   .arg(r->errorString()));
+    }
+}
+
+MemoryUsage TalkerAccount::memory_usage() const {
+    MemoryUsage usage;
+    usage.script_engines = 1;
+    // the network manager is usually shared, it is counted by its owner
+    usage.net_managers = (m_net && m_net->parent() == this) ? 1 : 0;
+    return usage;
+}
+
+QString TalkerAccount::intern_name(const QString &name) {
+    QSet<QString>::const_iterator it = m_names.constFind(name);
+    if (it == m_names.constEnd()) {
+        it = m_names.insert(name);
+    }
+    return *it;
+}
+
+void TalkerAccount::trim_caches() {
+    m_engine->collectGarbage();
+    foreach(TalkerRoom *r, m_rooms) {
+        r->trim_caches();
     }
-    r->deleteLater();
 }
 
 void TalkerAccount::open_room(const int room_id) {
-    foreach(QString name, this->m_avail_rooms.keys()) {
-        int id = m_avail_rooms[name];
-        if (id == room_id) {
-            TalkerRoom *room = new TalkerRoom(this, name, id, this);
-            connect(room, SIGNAL(connected(const TalkerRoom*)),
-                    SLOT(on_room_connected(const TalkerRoom*)));
-            connect(room, SIGNAL(disconnected(TalkerRoom*)),
-                    SLOT(on_room_disconnected(TalkerRoom*)));
-            connect(room, SIGNAL(new_status_message(QString)),
-                    SIGNAL(new_status_message(QString))); // pass through
-            room->join_room();
-            m_open_rooms.insert(name, QVariant(id));
-        }
+    // rooms are in m_rooms from the moment they start connecting until
+    // they disconnect or fail to connect
+    if (!m_room_names.contains(room_id) || is_room_open(room_id)) {
+        return;
     }
+    QString name = m_room_names.value(room_id);
+    TalkerRoom *room = new TalkerRoom(this, name, room_id, this);
+    connect(room, SIGNAL(connected(const TalkerRoom*)),
+            SLOT(on_room_connected(const TalkerRoom*)));
+    connect(room, SIGNAL(disconnected(TalkerRoom*)),
+            SLOT(on_room_disconnected(TalkerRoom*)));
+    connect(room, SIGNAL(new_status_message(QString)),
+            SIGNAL(new_status_message(QString))); // pass through
+    connect(room, SIGNAL(error(QString,QString)),
+            SIGNAL(error(QString,QString)));
+    m_rooms.insert(room_id, room);
+    room->join_room();
+    m_open_rooms.insert(name, QVariant(room_id));
 }
 
 void TalkerAccount::close_room(const int room_id) {
-    foreach(TalkerRoom *r, m_active_rooms) {
-        if (r->id() == room_id) {
-            r->logout();
-            foreach(QString name, m_open_rooms.keys()) {
-                if (m_open_rooms[name].toInt() == r->id()) {
-                    m_open_rooms.remove(name);
-                }
-            }
-        }
+    TalkerRoom *r = m_active_rooms.value(room_id);
+    if (!r) {
+        return;
+    }
+    r->logout();
+    if (m_open_rooms.value(r->name()).toInt() == room_id) {
+        m_open_rooms.remove(r->name());
     }
 }
 
 void TalkerAccount::on_room_connected(const TalkerRoom *room) {
     qDebug() << "ROOM CONNECTED:" << room << "connected OK";
     emit room_connected(room);
-    m_active_rooms.append(const_cast<TalkerRoom*>(room));
+    m_active_rooms.insert(room->id(), const_cast<TalkerRoom*>(room));
 }
 
 void TalkerAccount::on_room_disconnected(TalkerRoom *room) {
     qDebug() << "ROOM DISCONNECTED:" << room << "disconnected";
-    m_active_rooms.removeAll(const_cast<TalkerRoom*>(room));
+    m_rooms.remove(room->id());
+    m_active_rooms.remove(room->id());
     room->deleteLater();
     emit room_disconnected(room->id());
 }
-
-TalkerAccount* TalkerAccount::create_new(QObject *account_owner,
-                                         QWidget *dialog_parent) {
-    TalkerAccount *acct = new TalkerAccount("", "", "", account_owner);
-
-    if (!acct->edit()) { // if they cancel delete the temp object we made
-        acct->deleteLater();
-        acct = NULL; // give back nothing
-    }
-
-    return acct;
-}
-
-bool TalkerAccount::edit() {
-    QDialog *d = new QDialog(NULL);
-    Ui::AccountEditDialog ui;
-    ui.setupUi(d); // paint the dialog
-    ui.le_name->setText(m_name);
-    ui.le_token->setText(m_token);
-    ui.le_domain->setText(m_domain);
-    bool accepted = d->exec();
-    if (accepted) { // only make an account if they accepted the dialog
-        m_name = ui.le_name->text().trimmed();
-        m_token = ui.le_token->text().trimmed();
-        m_domain = ui.le_domain->text().trimmed();
-    }
-    d->deleteLater();
-    return accepted;
-}
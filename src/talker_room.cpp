@@ -20,14 +20,23 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
-#include <QtGui>
+#include <QtCore>
 #include <QtNetwork>
 #include <QtScript>
 
-#include "main_window.h" // to get settings
+#include "settings_store.h"
+#include "event_journal.h"
+#include "event_filter.h"
+#include "wire_capture.h"
+#include "latency_tracer.h"
 #include "talker_room.h"
 #include "talker_user.h"
 
+// messages up to this old when we connected still count as live
+static const int CATCH_UP_SLACK_SECS = 30;
+
+QString TalkerRoom::s_state_name;
+
 TalkerRoom::TalkerRoom(TalkerAccount *acct, const QString &room_name,
                        const int id, QObject *parent)
     : QObject(parent)
@@ -40,9 +49,16 @@ TalkerRoom::TalkerRoom(TalkerAccount *acct, const QString &room_name,
     , m_net(new QNetworkAccessManager(this))
     , m_engine(new QScriptEngine(this))
     , m_timer(new QTimer(this))
-    , m_chat(new QTableView(0))
-    , m_model(new QStandardItemModel(this))
     , m_users(QMap<int, TalkerUser*>())
+    , m_ingesting(false)
+    , m_recorder(0)
+    , m_read_usec(0)
+    , m_parsed_usec(0)
+    , m_metrics(Metrics::room(id, room_name))
+    , m_ping_usec(0)
+    , m_catching_up(false)
+    , m_reached(false)
+    , m_connect_failed(false)
 {
     m_users.clear();
 
@@ -55,26 +71,16 @@ TalkerRoom::TalkerRoom(TalkerAccount *acct, const QString &room_name,
             SLOT(socket_ssl_errors(QList<QSslError>)));
     connect(m_ssl, SIGNAL(readyRead()), SLOT(socket_ready_read()));
     connect(m_ssl, SIGNAL(disconnected()), SLOT(socket_disconnected()));
+    connect(m_ssl, SIGNAL(error(QAbstractSocket::SocketError)),
+            SLOT(socket_error(QAbstractSocket::SocketError)));
     connect(m_ssl, SIGNAL(stateChanged(QAbstractSocket::SocketState)),
             SLOT(socket_state_changed(QAbstractSocket::SocketState)));
     connect(m_timer, SIGNAL(timeout()), SLOT(stay_alive()));
-
-    m_chat->horizontalHeader()->setStretchLastSection(true);
-    m_chat->horizontalHeader()->show();
-    m_chat->verticalHeader()->hide();
-    m_chat->setEditTriggers(QAbstractItemView::NoEditTriggers);
-    m_chat->setWordWrap(true);
-    m_chat->setShowGrid(false);
-    m_chat->setAlternatingRowColors(true);
-    m_chat->setIconSize(QSize(24, 24));
-    m_chat->setSelectionBehavior(QAbstractItemView::SelectRows);
-    m_chat->setStyleSheet("QTableView {border: 0px;}");
-    m_chat->setModel(m_model);
-    m_chat->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
     load();
 }
 
 TalkerRoom::~TalkerRoom() {
+    delete m_recorder;
     foreach(TalkerUser *u, m_users.values()) {
         delete u;
     }
@@ -82,31 +88,57 @@ TalkerRoom::~TalkerRoom() {
 }
 
 void TalkerRoom::save() {
-    QSettings *s = new QSettings(QSettings::IniFormat, QSettings::UserScope,
-                                 QCoreApplication::organizationName(),
-                                 QCoreApplication::applicationName(), this);
-    s->beginGroup(QString("room_%1").arg(m_id));
-    s->setValue("id", m_id);
-    s->setValue("name", m_name);
-    s->setValue("last_event_id", m_last_event_id);
-    s->endGroup();
-    delete s;
+    SettingsStore *store = SettingsStore::instance();
+    if (!store) {
+        // app is shutting down and settings were already written, or this
+        // is a bench or replay room that must not leave state behind
+        return;
+    }
+    m_seen.save(filter_path());
+    // queued, the store writes all rooms in one go
+    QString group = state_group();
+    store->set_value(group + "id", m_id);
+    store->set_value(group + "name", m_name);
+    store->set_value(group + "last_event_id", m_last_event_id);
 }
 
 void TalkerRoom::load() {
-    QSettings *s = new QSettings(QSettings::IniFormat, QSettings::UserScope,
-                                 QCoreApplication::organizationName(),
-                                 QCoreApplication::applicationName(), this);
-    s->beginGroup(QString("room_%1").arg(m_id));
-    m_last_event_id = s->value("last_event_id").toString();
-    s->endGroup();
-    delete s;
+    SettingsStore *store = SettingsStore::instance();
+    if (store) {
+        m_last_event_id = store->value(state_group() + "last_event_id")
+                          .toString();
+        m_opts = store->options();
+        m_seen.load(filter_path());
+    } else {
+        m_opts = OptionsPtr(new Options()); // defaults, and no saved filter
+    }
+
+    // the journal is never older than the settings, and survives crashes
+    EventJournal *journal = EventJournal::instance();
+    if (journal && !journal->last_event_id(m_id).isEmpty()) {
+        m_last_event_id = journal->last_event_id(m_id);
+    }
+}
+
+QString TalkerRoom::filter_path() const {
+    QString dir = QFileInfo(SettingsStore::instance()->settings()->fileName())
+                  .absolutePath();
+    QString filters = s_state_name.isEmpty() ? QString("filters")
+                                             : "filters_" + s_state_name;
+    return QString("%1/%2/room_%3.dat").arg(dir).arg(filters).arg(m_id);
+}
+
+QString TalkerRoom::state_group() const {
+    if (s_state_name.isEmpty()) {
+        return QString("room_%1/").arg(m_id);
+    }
+    return QString("%1/room_%2/").arg(s_state_name).arg(m_id);
 }
 
 void TalkerRoom::join_room() const {
     // open a connection
     status_message(tr("connecting to server..."));
-    m_ssl->connectToHostEncrypted("talkerapp.com", 8500);
+    m_ssl->connectToHostEncrypted(m_opts->server_host, m_opts->server_port);
 }
 
 void TalkerRoom::logout() {
@@ -147,21 +179,47 @@ void TalkerRoom::socket_encrypted() {
         body = body.arg(m_name).arg(m_acct->token());
     }
     m_ssl->write(body.toAscii());
+    m_connected_at = QDateTime::currentDateTime();
+    m_catching_up = true;
+    m_metrics->connects.fetchAndAddRelaxed(1);
     emit connected(this);
 
-    // make our widget ready to rock...
-    m_model->clear();
-    QStringList labels;
-    labels << tr("Time") << tr("User") << tr("Message");
-    m_model->setHorizontalHeaderLabels(labels);
+    if (m_opts->record_traffic && !m_recorder) {
+        QString path = QString("%1/room_%2_%3.stwc").arg(m_opts->capture_dir)
+                       .arg(m_id).arg(QDateTime::currentDateTime()
+                                      .toString("yyyyMMdd-hhmmss"));
+        m_recorder = new WireRecorder(path, m_name, m_id,
+                                      m_acct->token().toAscii());
+    }
 }
 
 void TalkerRoom::socket_ssl_errors(const QList<QSslError> &errors) {
     qWarning() << "\tSSL ERROR:" << errors;
+    if (m_opts->ignore_ssl_errors) { // e.g. a local test server
+        m_ssl->ignoreSslErrors();
+    }
 }
 
 void TalkerRoom::socket_state_changed(QAbstractSocket::SocketState state) {
     //qDebug() << "\tRoom:" << m_name << "socket state changed to:" << state;
+    if (state == QAbstractSocket::ConnectedState) {
+        m_reached = true;
+    }
+}
+
+void TalkerRoom::socket_error(QAbstractSocket::SocketError error) {
+    if (m_reached || m_connect_failed) {
+        return; // socket_disconnected() reports it
+    }
+    // a connect that fails never emits disconnected(), report it the same
+    // way so the account lets go of the room and it can be opened again
+    m_connect_failed = true;
+    qWarning() << this << "could not connect:" << error
+            << m_ssl->errorString();
+    status_message(tr("could not connect to server: %1")
+                   .arg(m_ssl->errorString()));
+    emit disconnected(this);
+    m_timer->stop();
 }
 
 void TalkerRoom::socket_disconnected() {
@@ -174,25 +232,84 @@ void TalkerRoom::socket_disconnected() {
 
 void TalkerRoom::socket_ready_read() {
     // get the server's reply
-    QString reply = QString(m_ssl->readAll()).trimmed();
-    //qDebug() << QString("server said: (%1)").arg(reply);
+    QByteArray data = m_ssl->readAll();
+    if (m_recorder) {
+        m_recorder->record(data);
+    }
+    ingest(data);
+}
 
+void TalkerRoom::ingest(const QByteArray &data) {
+    // events are CRLF delimited, one read can hold several events or just
+    // part of one, so only complete lines are handled
+    m_read_usec = LatencyTracer::now_usec();
+    m_metrics->bytes.add(data.size());
+    if (m_ping_usec) {
+        // the server has no pong, any data after a ping is the best we have
+        m_metrics->keepalive_rtt_usec.fetchAndStoreRelaxed(
+                int(qMin(m_read_usec - m_ping_usec, qint64(0x7fffffff))));
+        m_ping_usec = 0;
+    }
+    m_read_buffer.append(data);
+    if (m_ingesting) {
+        // a handler ran the event loop and more data came in, the loop
+        // below reaches it after the lines that came before it
+        return;
+    }
+    m_ingesting = true;
+    int start = 0;
+    int end;
+    while ((end = m_read_buffer.indexOf('\n', start)) != -1) {
+        QByteArray line = m_read_buffer.mid(start, end - start).trimmed();
+        start = end + 1;
+        if (!line.isEmpty() && !handle_event(line)) {
+            m_read_buffer.clear(); // we logged out, drop the rest
+            m_metrics->queue_depth.fetchAndStoreRelaxed(0);
+            m_ingesting = false;
+            return;
+        }
+    }
+    m_read_buffer.remove(0, start);
+    m_ingesting = false;
+    m_metrics->queue_depth.fetchAndStoreRelaxed(
+            m_read_buffer.size() + int(m_ssl->bytesAvailable()));
+}
+
+bool TalkerRoom::handle_event(const QByteArray &line) {
+    QString reply = QString::fromUtf8(line);
+    //qDebug() << QString("server said: (%1)").arg(reply);
 
     QScriptValue val = m_engine->evaluate(QString("(%1)").arg(reply));
+    m_metrics->events.add(1);
     if (m_engine->hasUncaughtException()) {
+        m_metrics->parse_errors.fetchAndAddRelaxed(1);
         qWarning() << "SCRIPT EXCEPTION"
                 << m_engine->uncaughtException().toString();
-        QMessageBox::warning(NULL, tr("Communication Error!"),
-                             tr("Failed to parse response from server:\n\n%1")
-                             .arg(reply));
+        emit error(tr("Communication Error!"),
+                   tr("Failed to parse response from server:\n\n%1")
+                   .arg(reply));
         logout();
-        return;
+        return false;
     }
+    m_parsed_usec = LatencyTracer::now_usec();
 
     QString response_type = val.property("type").toString();
-    if (!val.property("id").isNull()) {
-        m_last_event_id = val.property("id").toString();
+    QScriptValue event_id = val.property("id");
+    QString id; // stays empty for events without an id, like "connected"
+    if (event_id.isValid() && !event_id.isUndefined() && !event_id.isNull()) {
+        id = event_id.toString();
+        m_last_event_id = id;
+        if (EventJournal::instance()) {
+            EventJournal::instance()->record(m_id, m_last_event_id);
+        }
+        // drop events the server replays that we already have
+        if ((response_type == "message" || response_type == "join" ||
+             response_type == "leave") && m_seen.seen(m_last_event_id)) {
+            //qDebug() << "dropping duplicate event" << m_last_event_id;
+            return true;
+        }
     }
+    emit event_received(this, id, line);
     //qDebug() << "RESPONSE DISPATCH:" << response_type;
     if (response_type == "connected") {
         m_user_id = val.property("user").property("id").toInteger();
@@ -219,18 +336,19 @@ void TalkerRoom::socket_ready_read() {
     } else if (response_type == "error") {
         QString msg = val.property("message").toString();
         qWarning() << "SERVER SENT ERROR:" << msg;
-        QMessageBox::warning(NULL, tr("Server Error!"),
-                             tr("Server sent the following error:\n\n%1")
-                             .arg(msg));
+        emit error(tr("Server Error!"),
+                   tr("Server sent the following error:\n\n%1").arg(msg));
     } else {
         qDebug() << "unhandled message type" << response_type;
     }
+    return true;
 }
 
 void TalkerRoom::stay_alive() {
     //qDebug() << "pinging...";
     if (m_ssl->isEncrypted() && m_ssl->isWritable()) {
         m_ssl->write("{\"type\":\"ping\"}\r\n");
+        m_ping_usec = LatencyTracer::now_usec();
     }
 }
 
@@ -271,63 +389,24 @@ void TalkerRoom::handle_message(const QScriptValue &val) {
         return;
     }
 
-    int time = val.property("time").toInt32();
-    QString content = val.property("content").toString();
-    content = content.replace("&lt;", "<", Qt::CaseInsensitive);
-    content = content.replace("&gt;", ">", Qt::CaseInsensitive);
-    content = content.replace("&quot;", "\"", Qt::CaseInsensitive);
-    content = content.replace("<br/>", "\n", Qt::CaseSensitive);
-
-    QDateTime timestamp;
-    timestamp.setTime_t(time);
-
-    //qDebug() << "got message from:" << m_users[sender_id]->name
-    //        << "MSG:" << content;
-
-    // is this another message from the same user who sent the last message?
-    QModelIndex last_msg = m_model->index(m_model->rowCount()-1, 1);
-    bool append_mode = false;
-    int last_sender_id = -1;
-    if (last_msg.isValid()) {
-        last_sender_id = m_model->data(last_msg, Qt::UserRole).toInt();
-        if (sender_id == last_sender_id) {
-            append_mode = true;
-        }
-    }
-
-    if (append_mode) {
-        QStandardItem *last_msg = m_model->item(m_model->rowCount()-1, 2);
-        last_msg->setText(QString("%1\n%2").arg(last_msg->text()).arg(content));
-    } else {
-        QStandardItem *i_sender = new QStandardItem(u->name);
-        i_sender->setData(u->id, Qt::UserRole);
-        if (!u->avatar.isNull()) {
-            i_sender->setIcon(u->avatar);
-        }
-        QStandardItem *i_content = new QStandardItem(content);
-        i_content->setData(val.property("id").toString(), Qt::UserRole);
-        QStandardItem *i_time = new QStandardItem(timestamp.toString("h:mmap"));
-        m_model->appendRow(QList<QStandardItem*>() << i_time << i_sender
-                           << i_content);
-
-        i_time->setTextAlignment(Qt::AlignLeft | Qt::AlignTop);
-        i_sender->setTextAlignment(Qt::AlignLeft | Qt::AlignTop);
-        i_content->setTextAlignment(Qt::AlignLeft | Qt::AlignTop);
+    RoomMessage msg;
+    msg.event_id = val.property("id").toString();
+    msg.time = time_from_message(val);
+    // the backlog comes oldest first, the first message sent after we
+    // connected ends it; a little slack for the server's clock
+    if (m_catching_up &&
+        msg.time.secsTo(m_connected_at) < CATCH_UP_SLACK_SECS) {
+        m_catching_up = false;
     }
-    m_chat->resizeColumnToContents(0);
-    m_chat->resizeColumnToContents(1);
-    m_chat->resizeRowsToContents();
-
-    /* Next 3 lines are an attempted workaround for scrolling bug
-       sometimes when a chat comes in from the same person and adds to an
-       existing chat line in the GUI, it fails to scroll all the way down.
-       This attempts to let the gui re-layout itself before calling scroll
-       */
-    qApp->sendPostedEvents();
-    qApp->processEvents();
-    QTimer::singleShot(100, m_chat, SLOT(scrollToBottom()));
+    msg.user_id = sender_id;
+    msg.user_name = u->name;
+    msg.content = decode_entities(val.property("content").toString());
+    msg.highlights = m_opts->highlights->match(msg.content);
 
-    emit message_received(u->name, content, this);
+    //qDebug() << "got message from:" << m_users[sender_id]->name
+    //        << "MSG:" << msg.content;
+    emit message_added(msg);
+    emit message_received(u->name, msg.content, msg.highlights, this);
 }
 
 void TalkerRoom::handle_idle(const QScriptValue &val) {
@@ -374,8 +453,8 @@ void TalkerRoom::handle_join(const QScriptValue &val) {
         if (u->id == m_user_id) {
             return; // ignore these messages for ourselves
         }
-        system_message(timestamp.toString("h:mmap"),
-                       QString("%1 has joined the room").arg(u->name));
+        emit system_message(timestamp,
+                            QString("%1 has joined the room").arg(u->name));
         emit user_updated(this, u);
     } else {
         qWarning() << "got join event and had trouble adding the user";
@@ -388,8 +467,8 @@ void TalkerRoom::handle_leave(const QScriptValue &val) {
     TalkerUser *u = m_users.take(user_id);
     if (u) {
         qDebug() << "user left room" << u->id << u->name;
-        system_message(timestamp.toString("h:mmap"),
-                       QString("%1 has left the room").arg(u->name));
+        emit system_message(timestamp,
+                            QString("%1 has left the room").arg(u->name));
         delete u;
         emit users_updated(this);
     } else {
@@ -402,7 +481,10 @@ void TalkerRoom::submit_message(const QString &msg) {
         return; // don't send blank messages
     }
     if (m_ssl && m_ssl->isEncrypted()) {
-        QString encoded = Qt::escape(msg);
+        // what Qt::escape does, which would pull in QtGui
+        QString encoded(msg);
+        encoded.replace("&", "&amp;").replace("<", "&lt;")
+               .replace(">", "&gt;").replace("\"", "&quot;");
         encoded = encoded.replace("\r\n", "<br/>", Qt::CaseSensitive);
         encoded = encoded.replace("\n", "<br/>", Qt::CaseSensitive);
         encoded = encoded.replace("\r", "<br/>", Qt::CaseSensitive);
@@ -415,9 +497,8 @@ void TalkerRoom::submit_message(const QString &msg) {
     }
 }
 
-void TalkerRoom::on_options_changed(QSettings *s) {
-    m_chat->setColumnHidden(0, !s->value("options/show_timestamps", true)
-                            .toBool());
+void TalkerRoom::on_options_changed(OptionsPtr opts) {
+    m_opts = opts;
 }
 
 void TalkerRoom::on_user_updated(const TalkerUser *user) {
@@ -434,20 +515,44 @@ TalkerUser *TalkerRoom::add_user(const QScriptValue &user) {
                                    user.property("email").toString().trimmed(),
                                    user_id, this);
     m_users[u->id] = u;
-    u->request_avatar(m_net);
+    if (m_acct->fetch_avatars()) {
+        u->request_avatar(m_net);
+    }
     connect(u, SIGNAL(updated(const TalkerUser*)),
             SLOT(on_user_updated(const TalkerUser*)));
     return u;
 }
 
-void TalkerRoom::system_message(const QString &time, const QString &message) {
-    QStandardItem *i_time = new QStandardItem(time);
-    QStandardItem *i_icon = new QStandardItem(
-            QIcon(":img/icons/information.png"), "");
-    QStandardItem *i_msg = new QStandardItem(message);
-    i_time->setForeground(QBrush(Qt::gray));
-    i_msg->setForeground(QBrush(Qt::gray));
-    m_model->appendRow(QList<QStandardItem*>() << i_time << i_icon << i_msg);
+MemoryUsage TalkerRoom::memory_usage() const {
+    MemoryUsage usage;
+    usage.net_managers = 1;
+    usage.script_engines = 1;
+    foreach(TalkerUser *u, m_users.values()) {
+        if (!u) {
+            continue; // operator[] lookups leave empty entries behind
+        }
+        usage.users++;
+        usage.user_bytes += sizeof(TalkerUser) + sizeof(QChar) *
+                            (u->name.size() + u->email.size());
+        if (!u->avatar_data.isEmpty()) {
+            usage.avatars++;
+            usage.avatar_bytes += u->avatar_data.size();
+        }
+    }
+    return usage;
+}
+
+void TalkerRoom::trim_caches() {
+    m_engine->collectGarbage();
+}
+
+QString TalkerRoom::decode_entities(const QString &content) {
+    QString decoded(content);
+    decoded.replace("&lt;", "<", Qt::CaseInsensitive);
+    decoded.replace("&gt;", ">", Qt::CaseInsensitive);
+    decoded.replace("&quot;", "\"", Qt::CaseInsensitive);
+    decoded.replace("<br/>", "\n", Qt::CaseSensitive);
+    return decoded;
 }
 
 QDateTime TalkerRoom::time_from_message(const QScriptValue &val) {
@@ -29,7 +29,7 @@ TalkerUser::TalkerUser(const QString &name, const QString &email,
     , name(name)
     , email(email)
     , id(id)
-    , avatar(QIcon())
+    , avatar_data(QByteArray())
     , idle(false)
     , avatar_requested(false)
 {
@@ -74,10 +74,11 @@ void TalkerUser::on_avatar_loaded() {
             qDebug() << "\t" << header << ":" << r->rawHeader(header);
         }
         */
-        QPixmap av = QPixmap::fromImage(
-                QImage::fromData(r->readAll(), r->rawHeader("Content-Type")));
-        if (!av.isNull()) {
-            avatar = av;
+        // kept encoded, views decode it when they have something to draw
+        QByteArray data = r->readAll();
+        if (!data.isEmpty() && r->rawHeader("Content-Type")
+                .startsWith("image/")) {
+            avatar_data = data;
             emit updated(this);
         }
     }
@@ -0,0 +1,74 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtCore>
+
+#include "text_arena.h"
+
+// size of a chunk, a few hundred typical messages
+static const int CHUNK_BYTES = 64 * 1024;
+// strings bigger than this get a chunk of their own
+static const int BIG_STRING_BYTES = CHUNK_BYTES / 4;
+
+TextArena::TextArena()
+    : m_current(-1)
+    , m_bytes(0)
+    , m_used(0)
+{}
+
+TextRef TextArena::add(const QString &text) {
+    TextRef ref;
+    if (text.isEmpty()) {
+        return ref;
+    }
+    QByteArray utf8 = text.toUtf8();
+    ref.size = utf8.size();
+    m_used += utf8.size();
+
+    if (utf8.size() > BIG_STRING_BYTES) {
+        // e.g. a pasted log, don't waste the rest of a chunk on it
+        ref.chunk = m_chunks.size();
+        m_chunks.append(utf8);
+        m_bytes += utf8.size();
+        return ref;
+    }
+    if (m_current == -1 ||
+        m_chunks.at(m_current).size() + utf8.size() > CHUNK_BYTES) {
+        m_current = m_chunks.size();
+        m_chunks.append(QByteArray());
+        m_chunks.last().reserve(CHUNK_BYTES);
+        m_bytes += CHUNK_BYTES;
+    }
+    QByteArray &chunk = m_chunks[m_current];
+    ref.chunk = m_current;
+    ref.offset = chunk.size();
+    chunk.append(utf8); // within the reserved capacity
+    return ref;
+}
+
+QString TextArena::text(const TextRef &ref) const {
+    if (!ref.size) {
+        return QString();
+    }
+    return QString::fromUtf8(m_chunks.at(ref.chunk).constData() + ref.offset,
+                             ref.size);
+}
@@ -0,0 +1,210 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtCore>
+
+#include "transcript_export.h"
+#include "json_string.h"
+
+// the writer's buffer, and roughly all the memory an export needs
+static const int BUFFER_BYTES = 64 * 1024;
+// history records read at a time
+static const int PAGE_RECORDS = 500;
+
+/**
+  * Escape text for HTML, what Qt::escape does without pulling in QtGui
+  */
+static QString html_escape(const QString &text) {
+    QString escaped(text);
+    escaped.replace("&", "&amp;").replace("<", "&lt;")
+           .replace(">", "&gt;").replace("\"", "&quot;");
+    return escaped;
+}
+
+TranscriptWriter::TranscriptWriter(QIODevice *out, const Format format)
+    : m_out(out)
+    , m_format(format)
+    , m_ok(true)
+{
+    m_buffer.reserve(BUFFER_BYTES);
+}
+
+TranscriptWriter::Format TranscriptWriter::format_for(const QString &path) {
+    QString suffix = QFileInfo(path).suffix().toLower();
+    if (suffix == "html" || suffix == "htm") {
+        return Html;
+    } else if (suffix == "jsonl" || suffix == "json") {
+        return JsonLines;
+    }
+    return Text;
+}
+
+bool TranscriptWriter::begin(const QString &room_name) {
+    if (m_format == Html) {
+        put(QString("<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\">"
+                    "<title>%1</title></head><body>\n<h1>%1</h1>\n<table>\n")
+            .arg(html_escape(room_name)).toUtf8());
+    }
+    return m_ok;
+}
+
+bool TranscriptWriter::write(const HistoryRecord &r) {
+    QString time = r.time.toString(Qt::ISODate);
+    bool system = r.kind == HistoryRecord::System;
+    QString line;
+    if (m_format == Html) {
+        QString text = html_escape(r.content).replace("\n", "<br/>");
+        line = QString("<tr%1><td>%2</td><td>%3</td><td>%4</td></tr>\n")
+               .arg(system ? " class=\"system\"" : "").arg(time)
+               .arg(system ? QString() : html_escape(r.user_name))
+               .arg(system ? QString("<i>%1</i>").arg(text) : text);
+    } else if (m_format == JsonLines) {
+        line = QString("{\"time\":%1,\"type\":%2")
+               .arg(json_string(time))
+               .arg(system ? "\"system\"" : "\"message\"");
+        if (!system) {
+            line += QString(",\"user_id\":%1,\"user\":%2,\"event_id\":%3")
+                    .arg(r.user_id).arg(json_string(r.user_name))
+                    .arg(json_string(r.event_id));
+        }
+        line += QString(",\"content\":%1}\n").arg(json_string(r.content));
+    } else if (system) {
+        line = QString("[%1] * %2\n").arg(time).arg(r.content);
+    } else {
+        line = QString("[%1] <%2> %3\n").arg(time).arg(r.user_name)
+               .arg(r.content);
+    }
+    put(line.toUtf8());
+    return m_ok;
+}
+
+bool TranscriptWriter::finish() {
+    if (m_format == Html) {
+        put("</table>\n</body></html>\n");
+    }
+    return drain() && m_ok;
+}
+
+void TranscriptWriter::put(const QByteArray &data) {
+    if (m_buffer.size() + data.size() > BUFFER_BYTES) {
+        drain();
+    }
+    if (data.size() > BUFFER_BYTES) {
+        // a huge message goes straight through instead of growing the buffer
+        m_ok = m_ok && m_out->write(data) == data.size();
+    } else {
+        m_buffer.append(data);
+    }
+}
+
+bool TranscriptWriter::drain() {
+    if (!m_buffer.isEmpty()) {
+        m_ok = m_ok && m_out->write(m_buffer) == m_buffer.size();
+        m_buffer.resize(0); // keeps the reserved capacity
+    }
+    return m_ok;
+}
+
+TranscriptExport::TranscriptExport(const QString &room_name,
+                                   const QString &history_path,
+                                   const qint64 history_size,
+                                   const QString &out_path)
+    : QObject(0)
+    , m_room_name(room_name)
+    , m_history_path(history_path)
+    , m_history_size(history_size)
+    , m_out_path(out_path)
+    , m_cancelled(0)
+{}
+
+TranscriptExport::TranscriptExport(const QString &room_name,
+                                   const QList<HistoryRecord> &records,
+                                   const QString &out_path)
+    : QObject(0)
+    , m_room_name(room_name)
+    , m_history_size(0)
+    , m_records(records)
+    , m_out_path(out_path)
+    , m_cancelled(0)
+{}
+
+TranscriptExport::~TranscriptExport() {
+    cancel();
+    m_thread.quit();
+    m_thread.wait();
+}
+
+void TranscriptExport::start() {
+    moveToThread(&m_thread);
+    m_thread.start(QThread::LowPriority);
+    QMetaObject::invokeMethod(this, "run", Qt::QueuedConnection);
+}
+
+void TranscriptExport::cancel() {
+    m_cancelled = 1;
+}
+
+void TranscriptExport::run() {
+    QFile out(m_out_path);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        emit finished(false, out.errorString());
+        return;
+    }
+    TranscriptWriter writer(&out, TranscriptWriter::format_for(m_out_path));
+    bool ok = writer.begin(m_room_name);
+
+    if (!m_history_path.isEmpty()) {
+        // a page at a time, so a huge history never sits in memory
+        qint64 pos = 0;
+        while (ok && !m_cancelled && pos < m_history_size) {
+            QList<HistoryRecord> page = RoomHistory::read_after(
+                    m_history_path, pos, PAGE_RECORDS, m_history_size);
+            if (page.isEmpty()) {
+                break; // damaged from here on, keep what was readable
+            }
+            foreach(const HistoryRecord &r, page) {
+                ok = ok && writer.write(r);
+            }
+            pos = page.last().next;
+            emit progress(int(pos * 1000 / m_history_size));
+        }
+    } else {
+        for (int i = 0; ok && !m_cancelled && i < m_records.size(); ++i) {
+            ok = writer.write(m_records.at(i));
+            if (i % PAGE_RECORDS == PAGE_RECORDS - 1) {
+                emit progress(int(qint64(i + 1) * 1000 / m_records.size()));
+            }
+        }
+        m_records.clear();
+    }
+
+    ok = writer.finish() && ok;
+    if (m_cancelled) {
+        out.remove(); // half a transcript is worse than none
+        emit finished(false, QString());
+    } else if (!ok) {
+        emit finished(false, out.errorString());
+    } else {
+        emit progress(1000);
+        emit finished(true, QString());
+    }
+}
@@ -0,0 +1,147 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtCore>
+
+#include "wire_capture.h"
+#include "talker_room.h"
+
+// written at the start of every capture
+static const quint32 CAPTURE_MAGIC = 0x53545743; // "STWC"
+static const quint32 CAPTURE_VERSION = 1;
+
+WireRecorder::WireRecorder(const QString &path, const QString &room_name,
+                           const int room_id, const QByteArray &token)
+    : m_file(path)
+    , m_token(token)
+{
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "could not open capture" << path << m_file.errorString();
+        return;
+    }
+    m_out.setDevice(&m_file);
+    m_out << CAPTURE_MAGIC << CAPTURE_VERSION << room_name << qint32(room_id)
+          << QDateTime::currentDateTime();
+    m_clock.start();
+    qDebug() << "recording traffic for" << room_name << "to" << path;
+}
+
+WireRecorder::~WireRecorder() {
+    if (m_file.isOpen() && !m_held.isEmpty()) {
+        // the capture ends in what may be most of the token
+        m_out << qint64(m_clock.elapsed()) << QByteArray("<redacted>");
+    }
+    m_file.close();
+}
+
+void WireRecorder::record(const QByteArray &data) {
+    if (!m_file.isOpen()) {
+        return;
+    }
+    QByteArray redacted = m_held + data;
+    m_held.clear();
+    if (!m_token.isEmpty()) {
+        redacted.replace(m_token, "<redacted>");
+        // the token may be split across two reads, so hold back any tail
+        // that could be its start until the next read shows the rest
+        int keep = qMin(redacted.size(), m_token.size() - 1);
+        while (keep > 0 && !m_token.startsWith(redacted.right(keep))) {
+            --keep;
+        }
+        m_held = redacted.right(keep);
+        redacted.chop(keep);
+    }
+    if (!redacted.isEmpty()) {
+        m_out << qint64(m_clock.elapsed()) << redacted;
+    }
+}
+
+WireReplayer::WireReplayer(QObject *parent)
+    : QObject(parent)
+    , m_room_id(0)
+    , m_bytes(0)
+    , m_ingest_ms(0)
+    , m_next(0)
+    , m_fast(false)
+    , m_room(0)
+{}
+
+bool WireReplayer::load(const QString &path) {
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        qWarning() << "could not open capture" << path << f.errorString();
+        return false;
+    }
+    QDataStream in(&f);
+    quint32 magic, version;
+    qint32 room_id;
+    QDateTime started;
+    in >> magic >> version >> m_room_name >> room_id >> started;
+    if (in.status() != QDataStream::Ok || magic != CAPTURE_MAGIC ||
+        version != CAPTURE_VERSION) {
+        qWarning() << path << "is not a traffic capture";
+        return false;
+    }
+    m_room_id = room_id;
+
+    m_chunks.clear();
+    m_bytes = 0;
+    while (!in.atEnd()) {
+        Chunk c;
+        in >> c.offset_ms >> c.data;
+        if (in.status() != QDataStream::Ok) {
+            break; // capture was cut short, keep what we have
+        }
+        m_bytes += c.data.size();
+        m_chunks.append(c);
+    }
+    qDebug() << "loaded" << m_chunks.size() << "reads," << m_bytes
+            << "bytes for room" << m_room_name << "recorded" << started;
+    return true;
+}
+
+void WireReplayer::start(TalkerRoom *room, const bool fast) {
+    m_room = room;
+    m_fast = fast;
+    m_next = 0;
+    m_ingest_ms = 0;
+    m_clock.start();
+    QTimer::singleShot(0, this, SLOT(feed()));
+}
+
+void WireReplayer::feed() {
+    QTime t;
+    while (m_next < m_chunks.size()) {
+        const Chunk &c = m_chunks.at(m_next);
+        int wait = int(c.offset_ms - m_clock.elapsed());
+        if (!m_fast && wait > 0) {
+            QTimer::singleShot(wait, this, SLOT(feed()));
+            return;
+        }
+        t.start();
+        m_room->ingest(c.data);
+        m_ingest_ms += t.elapsed();
+        ++m_next;
+    }
+    emit finished();
+}
@@ -0,0 +1,378 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtCore>
+#include <QtNetwork>
+#include <QtScript>
+
+#include "fake_talker.h"
+
+// how often live traffic is generated
+static const int TRAFFIC_TICK_MS = 50;
+// stop queueing replay once this much is waiting to go out on a socket
+static const qint64 REPLAY_HIGH_WATER = 256 * 1024;
+// our own user, every client logs in as this one
+static const int CLIENT_USER_ID = 1;
+// users that only drop in, each join is followed by its leave
+static const int FIRST_VISITOR_ID = 100000;
+static const int VISITORS = 50;
+
+static QByteArray json_escape(const QString &s) {
+    QString out;
+    out.reserve(s.size());
+    for (int i = 0; i < s.size(); ++i) {
+        QChar c = s.at(i);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c.unicode() < 0x20) {
+            out += QString("\\u%1").arg(c.unicode(), 4, 16, QChar('0'));
+        } else {
+            out += c;
+        }
+    }
+    return out.toUtf8();
+}
+
+SslServer::SslServer(const QSslCertificate &cert, const QSslKey &key,
+                     QObject *parent)
+    : QTcpServer(parent)
+    , m_cert(cert)
+    , m_key(key)
+{}
+
+void SslServer::incomingConnection(int socket_descriptor) {
+    QSslSocket *socket = new QSslSocket(this);
+    if (!socket->setSocketDescriptor(socket_descriptor)) {
+        qWarning() << "could not accept connection" << socket->errorString();
+        delete socket;
+        return;
+    }
+    socket->setLocalCertificate(m_cert);
+    socket->setPrivateKey(m_key);
+    emit new_client(socket);
+    socket->startServerEncryption();
+}
+
+FakeTalker::FakeTalker(const TrafficConfig &config, QObject *parent)
+    : QObject(parent)
+    , m_config(config)
+    , m_start_time(QDateTime::currentDateTime().toTime_t())
+    , m_engine(new QScriptEngine(this))
+    , m_traffic_timer(new QTimer(this))
+    , m_chat_server(0)
+    , m_http_server(0)
+{
+    for (int i = 0; i < m_config.rooms; ++i) {
+        Room r;
+        r.name = QString("Room %1").arg(i + 1);
+        r.id = 1000 + i;
+        r.next_event_id = m_config.backlog + 1;
+        r.pending = 0;
+        m_rooms.append(r);
+    }
+    connect(m_traffic_timer, SIGNAL(timeout()), SLOT(generate_traffic()));
+}
+
+bool FakeTalker::listen(quint16 chat_port, quint16 http_port,
+                        const QSslCertificate &cert, const QSslKey &key) {
+    m_chat_server = new SslServer(cert, key, this);
+    m_http_server = new SslServer(cert, key, this);
+    connect(m_chat_server, SIGNAL(new_client(QSslSocket*)),
+            SLOT(on_chat_client(QSslSocket*)));
+    connect(m_http_server, SIGNAL(new_client(QSslSocket*)),
+            SLOT(on_http_client(QSslSocket*)));
+    if (!m_chat_server->listen(QHostAddress::Any, chat_port)) {
+        qWarning() << "could not listen on" << chat_port
+                << m_chat_server->errorString();
+        return false;
+    }
+    if (!m_http_server->listen(QHostAddress::Any, http_port)) {
+        qWarning() << "could not listen on" << http_port
+                << m_http_server->errorString();
+        return false;
+    }
+    if (m_config.rate > 0) {
+        m_traffic_timer->start(TRAFFIC_TICK_MS);
+    }
+    qDebug() << "serving" << m_config.rooms << "rooms with" << m_config.users
+            << "users," << m_config.rate << "messages/sec per room and"
+            << m_config.backlog << "backlog events";
+    qDebug() << "chat on port" << chat_port << "rooms.json on port"
+            << http_port;
+    return true;
+}
+
+QByteArray FakeTalker::user_json(const int user_id) const {
+    if (user_id == CLIENT_USER_ID) {
+        return "{\"id\":1,\"name\":\"tester\",\"email\":\"tester@example.com\"}";
+    }
+    return QString("{\"id\":%1,\"name\":\"user%1\","
+                   "\"email\":\"user%1@example.com\"}").arg(user_id).toUtf8();
+}
+
+QByteArray FakeTalker::event(const Room &room, const qint64 event_id) const {
+    if (room.posted.contains(event_id)) {
+        return room.posted.value(event_id);
+    }
+    uint time;
+    if (event_id <= m_config.backlog) {
+        time = m_start_time - (m_config.backlog - event_id);
+    } else {
+        time = m_start_time + uint((event_id - m_config.backlog) /
+                                   qMax(m_config.rate, 0.001));
+    }
+    int user_id = 1000 + int(event_id % qMax(m_config.users, 1));
+
+    QString type("message");
+    if (event_id % 97 == 0) {
+        type = "idle";
+    } else if (event_id % 97 == 1) {
+        type = "back";
+    } else if (event_id % 97 == 2 || event_id % 97 == 3) {
+        // a visitor joins and leaves again with the next event, both
+        // events work out the same visitor from the id
+        type = event_id % 97 == 2 ? "join" : "leave";
+        user_id = FIRST_VISITOR_ID + int(event_id / 97 % VISITORS);
+    }
+    QByteArray line = "{\"type\":\"" + type.toUtf8() + "\",\"id\":\""
+                      + QByteArray::number(event_id) + "\",\"time\":"
+                      + QByteArray::number(time) + ",\"user\":"
+                      + user_json(user_id);
+    if (type == "message") {
+        line += ",\"content\":\"" + json_escape(
+                QString("message %1 from user%2 in %3 &lt;load test&gt;")
+                .arg(event_id).arg(user_id).arg(room.name)) + "\"";
+    }
+    return line + "}\r\n";
+}
+
+void FakeTalker::broadcast(Room &room, const QByteArray &line) {
+    qint64 event_id = room.next_event_id - 1;
+    foreach(QSslSocket *s, room.clients) {
+        Client &c = m_clients[s];
+        if (c.replay_next < c.replay_end) {
+            continue; // still replaying, pump_replay will get to this one
+        }
+        s->write(line);
+        c.replay_next = c.replay_end = event_id + 1;
+    }
+}
+
+void FakeTalker::generate_traffic() {
+    for (int i = 0; i < m_rooms.size(); ++i) {
+        Room &room = m_rooms[i];
+        room.pending += m_config.rate * TRAFFIC_TICK_MS / 1000.0;
+        while (room.pending >= 1.0) {
+            room.pending -= 1.0;
+            qint64 id = room.next_event_id++;
+            broadcast(room, event(room, id));
+        }
+    }
+}
+
+void FakeTalker::on_chat_client(QSslSocket *socket) {
+    m_clients.insert(socket, Client());
+    connect(socket, SIGNAL(readyRead()), SLOT(on_chat_ready_read()));
+    connect(socket, SIGNAL(bytesWritten(qint64)),
+            SLOT(on_chat_bytes_written()));
+    connect(socket, SIGNAL(disconnected()), SLOT(on_chat_disconnected()));
+}
+
+void FakeTalker::on_chat_ready_read() {
+    QSslSocket *socket = qobject_cast<QSslSocket*>(QObject::sender());
+    if (!socket || !m_clients.contains(socket)) {
+        return;
+    }
+    QByteArray &buffer = m_clients[socket].buffer;
+    buffer.append(socket->readAll());
+    int end;
+    while ((end = buffer.indexOf('\n')) != -1) {
+        QByteArray line = buffer.left(end).trimmed();
+        buffer.remove(0, end + 1);
+        if (!line.isEmpty()) {
+            handle_line(socket, line);
+        }
+        if (!m_clients.contains(socket)) {
+            return; // the client went away while we handled the line
+        }
+    }
+}
+
+void FakeTalker::handle_line(QSslSocket *socket, const QByteArray &line) {
+    QScriptValue val = m_engine->evaluate(
+            QString("(%1)").arg(QString::fromUtf8(line)));
+    if (m_engine->hasUncaughtException()) {
+        socket->write("{\"type\":\"error\",\"message\":\"Invalid JSON\"}\r\n");
+        return;
+    }
+    Client &c = m_clients[socket];
+    QString type = val.property("type").toString();
+
+    if (type == "connect") {
+        QString name = val.property("room").toString();
+        int idx = -1;
+        for (int i = 0; i < m_rooms.size(); ++i) {
+            if (m_rooms.at(i).name == name) {
+                idx = i;
+                break;
+            }
+        }
+        if (idx < 0 || val.property("token").toString().isEmpty()) {
+            socket->write("{\"type\":\"error\",\"message\":\"Unknown room\"}"
+                          "\r\n");
+            return;
+        }
+        Room &room = m_rooms[idx];
+        c.room = idx;
+        c.user_id = CLIENT_USER_ID;
+        c.replay_next = c.replay_end = room.next_event_id;
+        bool ok = false;
+        qint64 last = val.property("last_event_id").toString()
+                      .toLongLong(&ok);
+        if (ok && last < room.next_event_id) {
+            c.replay_next = qMax(last + 1, qint64(1));
+        }
+
+        socket->write("{\"type\":\"connected\",\"user\":" +
+                      user_json(c.user_id) + "}\r\n");
+        QByteArray users = "{\"type\":\"users\",\"users\":[" +
+                           user_json(c.user_id);
+        for (int u = 0; u < m_config.users; ++u) {
+            users += "," + user_json(1000 + u);
+        }
+        socket->write(users + "]}\r\n");
+
+        room.clients.append(socket);
+        pump_replay(socket);
+    } else if (type == "message" && c.room >= 0) {
+        Room &room = m_rooms[c.room];
+        qint64 id = room.next_event_id++;
+        QByteArray event = "{\"type\":\"message\",\"id\":\"" +
+                           QByteArray::number(id) + "\",\"time\":" +
+                           QByteArray::number(QDateTime::currentDateTime()
+                                              .toTime_t()) +
+                           ",\"user\":" + user_json(c.user_id) +
+                           ",\"content\":\"" +
+                           json_escape(val.property("content").toString()) +
+                           "\"}\r\n";
+        room.posted.insert(id, event);
+        broadcast(room, event);
+    } else if (type == "ping") {
+        // nothing to do, this just keeps the connection alive
+    } else if (type == "close") {
+        socket->disconnectFromHost();
+    } else {
+        qDebug() << "client sent unhandled message type" << type;
+    }
+}
+
+void FakeTalker::on_chat_bytes_written() {
+    QSslSocket *socket = qobject_cast<QSslSocket*>(QObject::sender());
+    if (socket && m_clients.contains(socket)) {
+        pump_replay(socket);
+    }
+}
+
+void FakeTalker::pump_replay(QSslSocket *socket) {
+    Client &c = m_clients[socket];
+    if (c.room < 0) {
+        return;
+    }
+    const Room &room = m_rooms.at(c.room);
+    c.replay_end = room.next_event_id; // catch up with live traffic too
+    while (c.replay_next < c.replay_end &&
+           socket->encryptedBytesToWrite() + socket->bytesToWrite()
+           < REPLAY_HIGH_WATER) {
+        socket->write(event(room, c.replay_next++));
+    }
+}
+
+void FakeTalker::on_chat_disconnected() {
+    QSslSocket *socket = qobject_cast<QSslSocket*>(QObject::sender());
+    if (!socket) {
+        return;
+    }
+    Client c = m_clients.take(socket);
+    if (c.room >= 0) {
+        m_rooms[c.room].clients.removeAll(socket);
+    }
+    socket->deleteLater();
+}
+
+void FakeTalker::on_http_client(QSslSocket *socket) {
+    m_http_buffers.insert(socket, QByteArray());
+    connect(socket, SIGNAL(readyRead()), SLOT(on_http_ready_read()));
+    connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+}
+
+void FakeTalker::on_http_ready_read() {
+    QSslSocket *socket = qobject_cast<QSslSocket*>(QObject::sender());
+    if (!socket) {
+        return;
+    }
+    m_http_buffers[socket].append(socket->readAll());
+    handle_http(socket);
+}
+
+void FakeTalker::handle_http(QSslSocket *socket) {
+    QByteArray &buffer = m_http_buffers[socket];
+    int end = buffer.indexOf("\r\n\r\n");
+    if (end == -1) {
+        return; // wait for the rest of the headers
+    }
+    QList<QByteArray> lines = buffer.left(end).split('\n');
+    buffer.remove(0, end + 4);
+
+    QList<QByteArray> request = lines.value(0).trimmed().split(' ');
+    QByteArray if_none_match;
+    for (int i = 1; i < lines.size(); ++i) {
+        QByteArray line = lines.at(i).trimmed();
+        if (line.toLower().startsWith("if-none-match:")) {
+            if_none_match = line.mid(14).trimmed();
+        }
+    }
+
+    QByteArray etag = "\"rooms-" + QByteArray::number(m_rooms.size()) + "\"";
+    QByteArray status("200 OK");
+    QByteArray body;
+    if (request.value(1) != "/rooms.json") {
+        status = "404 Not Found";
+    } else if (if_none_match == etag) {
+        status = "304 Not Modified";
+    } else {
+        body = "[";
+        for (int i = 0; i < m_rooms.size(); ++i) {
+            if (i) {
+                body += ",";
+            }
+            body += "{\"name\":\"" + json_escape(m_rooms.at(i).name) +
+                    "\",\"id\":" + QByteArray::number(m_rooms.at(i).id) + "}";
+        }
+        body += "]";
+    }
+    socket->write("HTTP/1.1 " + status + "\r\n"
+                  "Content-Type: application/json\r\n"
+                  "ETag: " + etag + "\r\n"
+                  "Content-Length: " + QByteArray::number(body.size()) +
+                  "\r\n\r\n" + body);
+}
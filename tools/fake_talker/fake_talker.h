@@ -0,0 +1,125 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef FAKE_TALKER_H
+#define FAKE_TALKER_H
+
+#include <QtCore>
+#include <QtNetwork>
+#include <QtScript>
+
+/**
+  * Accepts TCP connections and wraps each one in a server side QSslSocket
+  * using our self-signed certificate.
+  */
+class SslServer : public QTcpServer {
+    Q_OBJECT
+public:
+    SslServer(const QSslCertificate &cert, const QSslKey &key,
+              QObject *parent = 0);
+
+protected:
+    void incomingConnection(int socket_descriptor);
+
+private:
+    QSslCertificate m_cert;
+    QSslKey m_key;
+
+signals:
+    void new_client(QSslSocket *socket);
+};
+
+/**
+  * How much traffic the fake server makes up
+  */
+struct TrafficConfig {
+    TrafficConfig()
+        : rooms(3), users(20), rate(5.0), backlog(1000) {}
+
+    int rooms; // number of rooms served
+    int users; // users in each room
+    double rate; // generated messages per second in each room
+    int backlog; // events each room already has when the server starts
+};
+
+/**
+  * Local stand-in for talkerapp.com. Speaks the CRLF delimited JSON protocol
+  * TalkerRoom uses on one port and serves rooms.json over HTTPS on another,
+  * while generating a configurable amount of chat traffic.
+  *
+  * Event content is a function of the room and event id, so replaying from
+  * any last_event_id costs no memory no matter how large the backlog is.
+  */
+class FakeTalker : public QObject {
+    Q_OBJECT
+public:
+    FakeTalker(const TrafficConfig &config, QObject *parent = 0);
+
+    bool listen(quint16 chat_port, quint16 http_port,
+                const QSslCertificate &cert, const QSslKey &key);
+
+private:
+    struct Client {
+        Client() : room(-1), user_id(0), replay_next(0), replay_end(0) {}
+        QByteArray buffer; // partial line from the client
+        int room; // index into m_rooms, -1 until connected
+        int user_id; // the user this client logged in as
+        qint64 replay_next; // next event id to replay
+        qint64 replay_end; // first event id that is not part of the replay
+    };
+    struct Room {
+        QString name;
+        int id;
+        qint64 next_event_id; // id the next live event gets
+        double pending; // fraction of a message owed to the traffic rate
+        QList<QSslSocket*> clients;
+        QMap<qint64, QByteArray> posted; // events sent by real clients
+    };
+
+    TrafficConfig m_config;
+    uint m_start_time; // server start, backlog events happen before it
+    QList<Room> m_rooms;
+    QHash<QSslSocket*, Client> m_clients;
+    QScriptEngine *m_engine; // parses what the clients send us
+    QTimer *m_traffic_timer;
+    SslServer *m_chat_server;
+    SslServer *m_http_server;
+    QHash<QSslSocket*, QByteArray> m_http_buffers;
+
+    QByteArray user_json(const int user_id) const;
+    QByteArray event(const Room &room, const qint64 event_id) const;
+    void broadcast(Room &room, const QByteArray &line);
+    void handle_line(QSslSocket *socket, const QByteArray &line);
+    void pump_replay(QSslSocket *socket);
+    void handle_http(QSslSocket *socket);
+
+    private slots:
+        void on_chat_client(QSslSocket *socket);
+        void on_chat_ready_read();
+        void on_chat_bytes_written();
+        void on_chat_disconnected();
+        void on_http_client(QSslSocket *socket);
+        void on_http_ready_read();
+        void generate_traffic();
+};
+
+#endif // FAKE_TALKER_H
@@ -0,0 +1,26 @@
+# -------------------------------------------------
+# Local stand-in for talkerapp.com used for load and latency testing
+# -------------------------------------------------
+# QT libs we need
+QT += network \
+    script
+QT -= gui
+
+# basic app config
+TARGET = fake_talker
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+debug:DESTDIR = ../../bin/debug
+release:DESTDIR = ../../bin/release
+
+# where to put all the temporary crap
+OBJECTS_DIR = ../../bin/temp/fake_talker
+MOC_DIR = ../../bin/temp/fake_talker
+RCC_DIR = ../../bin/temp/fake_talker
+
+# what files to find
+SOURCES += main.cpp \
+    fake_talker.cpp
+HEADERS += fake_talker.h
+RESOURCES += fake_talker.qrc
@@ -0,0 +1,102 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtCore>
+#include <QtNetwork>
+
+#include "fake_talker.h"
+
+static void usage() {
+    QTextStream out(stderr);
+    out << "usage: fake_talker [options]\n"
+        << "  --port N       chat port (default 8500)\n"
+        << "  --http-port N  rooms.json port (default 8501)\n"
+        << "  --rooms N      rooms to serve (default 3)\n"
+        << "  --users N      users in each room (default 20)\n"
+        << "  --rate N       messages per second in each room (default 5)\n"
+        << "  --backlog N    events each room starts with (default 1000)\n"
+        << "  --cert FILE    PEM certificate (default: built in, self-signed)\n"
+        << "  --key FILE     PEM RSA key (default: built in)\n"
+        << "  --help         show this and exit\n";
+}
+
+static QByteArray read_file(const QString &path) {
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        qWarning() << "could not read" << path << f.errorString();
+        return QByteArray();
+    }
+    return f.readAll();
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+
+    TrafficConfig config;
+    quint16 port = 8500;
+    quint16 http_port = 8501;
+    QString cert_path(":/fake_talker.crt");
+    QString key_path(":/fake_talker.key");
+
+    QStringList args = a.arguments();
+    for (int i = 1; i < args.size(); ++i) {
+        QString arg = args.at(i);
+        QString value = args.value(i + 1);
+        if (arg == "--help" || arg == "-h") {
+            usage();
+            return 0;
+        } else if (arg == "--port") {
+            port = value.toUShort();
+        } else if (arg == "--http-port") {
+            http_port = value.toUShort();
+        } else if (arg == "--rooms") {
+            config.rooms = value.toInt();
+        } else if (arg == "--users") {
+            config.users = value.toInt();
+        } else if (arg == "--rate") {
+            config.rate = value.toDouble();
+        } else if (arg == "--backlog") {
+            config.backlog = value.toInt();
+        } else if (arg == "--cert") {
+            cert_path = value;
+        } else if (arg == "--key") {
+            key_path = value;
+        } else {
+            usage();
+            return 1;
+        }
+        ++i; // every option takes a value
+    }
+
+    QSslCertificate cert(read_file(cert_path));
+    QSslKey key(read_file(key_path), QSsl::Rsa);
+    if (cert.isNull() || key.isNull()) {
+        qWarning() << "a valid certificate and key are required";
+        return 1;
+    }
+
+    FakeTalker server(config);
+    if (!server.listen(port, http_port, cert, key)) {
+        return 1;
+    }
+    return a.exec();
+}
@@ -0,0 +1,255 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtCore>
+#include <QtNetwork>
+
+#include "event_gateway.h"
+#include "talker_room.h"
+
+// history kept per room for clients that connect late or reconnect
+static const int HISTORY_EVENTS = 5000;
+static const qint64 HISTORY_BYTES = 8 * 1024 * 1024;
+// a client this far behind is dropped, it can reconnect and replay
+static const qint64 MAX_PENDING_BYTES = 16 * 1024 * 1024;
+// frames from clients are small, anything bigger is garbage
+static const quint32 MAX_CLIENT_FRAME = 64 * 1024;
+
+EventGateway::EventGateway(QObject *parent)
+    : QObject(parent)
+    , m_server(new QLocalServer(this))
+{
+    connect(m_server, SIGNAL(newConnection()), SLOT(on_connection()));
+}
+
+EventGateway::~EventGateway() {
+}
+
+bool EventGateway::listen(const QString &name) {
+    QLocalServer::removeServer(name); // left behind if we crashed
+    if (!m_server->listen(name)) {
+        qWarning() << "gateway could not listen on" << name
+                << m_server->errorString();
+        return false;
+    }
+    qDebug() << "gateway listening on" << m_server->fullServerName();
+    return true;
+}
+
+QByteArray EventGateway::frame(const FrameType type, const quint32 room_id,
+                               const QByteArray &payload) {
+    QByteArray f;
+    f.reserve(9 + payload.size());
+    QDataStream out(&f, QIODevice::WriteOnly); // big endian
+    out << quint32(5 + payload.size()) << quint8(type) << room_id;
+    f.append(payload);
+    return f;
+}
+
+void EventGateway::add_room(const TalkerRoom *room) {
+    TalkerRoom *r = const_cast<TalkerRoom*>(room);
+    if (m_rooms.contains(r)) {
+        return;
+    }
+    m_rooms.insert(r, r);
+    m_history[room->id()].name = room->name();
+    connect(room,
+            SIGNAL(event_received(const TalkerRoom*,QString,QByteArray)),
+            SLOT(on_event(const TalkerRoom*,QString,QByteArray)));
+    connect(room, SIGNAL(destroyed(QObject*)),
+            SLOT(on_room_destroyed(QObject*)));
+
+    QByteArray f = frame(Room, room->id(), room->name().toUtf8());
+    foreach(QLocalSocket *s, m_clients.keys()) {
+        if (wants(m_clients.value(s), room->id())) {
+            send(s, f);
+        }
+    }
+}
+
+void EventGateway::on_room_destroyed(QObject *room) {
+    // the history stays, the room is usually joined again shortly
+    m_rooms.remove(room);
+}
+
+TalkerRoom *EventGateway::room(const quint32 room_id) const {
+    foreach(TalkerRoom *r, m_rooms) {
+        if (quint32(r->id()) == room_id) {
+            return r;
+        }
+    }
+    return 0;
+}
+
+bool EventGateway::wants(const Client &c, const quint32 room_id) const {
+    return !c.dropped && (c.all_rooms || c.rooms.contains(room_id));
+}
+
+void EventGateway::on_event(const TalkerRoom *room, const QString &event_id,
+                            const QByteArray &line) {
+    quint32 room_id = room->id();
+    QByteArray f = frame(Event, room_id, line);
+
+    History &h = m_history[room_id];
+    h.ids.enqueue(event_id);
+    h.frames.enqueue(f);
+    h.bytes += f.size();
+    while (h.frames.size() > HISTORY_EVENTS || h.bytes > HISTORY_BYTES) {
+        h.ids.dequeue();
+        h.bytes -= h.frames.dequeue().size();
+    }
+
+    foreach(QLocalSocket *s, m_clients.keys()) {
+        if (wants(m_clients.value(s), room_id)) {
+            send(s, f);
+        }
+    }
+}
+
+void EventGateway::send(QLocalSocket *s, const QByteArray &frame) {
+    if (s->state() != QLocalSocket::ConnectedState) {
+        return;
+    }
+    if (s->bytesToWrite() > MAX_PENDING_BYTES) {
+        if (!m_clients.value(s).dropped) {
+            qWarning() << "gateway client fell too far behind, dropping it";
+            // later, it must not leave m_clients while we loop over them
+            m_clients[s].dropped = true;
+            QTimer::singleShot(0, this, SLOT(drop_clients()));
+        }
+        return;
+    }
+    s->write(frame);
+}
+
+void EventGateway::drop_clients() {
+    QList<QLocalSocket*> dropped;
+    foreach(QLocalSocket *s, m_clients.keys()) {
+        if (m_clients.value(s).dropped) {
+            dropped.append(s);
+        }
+    }
+    foreach(QLocalSocket *s, dropped) {
+        s->abort();
+        if (m_clients.remove(s)) { // in case abort didn't say disconnected
+            s->deleteLater();
+        }
+    }
+}
+
+void EventGateway::on_connection() {
+    while (m_server->hasPendingConnections()) {
+        QLocalSocket *s = m_server->nextPendingConnection();
+        m_clients.insert(s, Client());
+        connect(s, SIGNAL(readyRead()), SLOT(on_ready_read()));
+        connect(s, SIGNAL(disconnected()), SLOT(on_client_disconnected()));
+    }
+}
+
+void EventGateway::on_client_disconnected() {
+    QLocalSocket *s = qobject_cast<QLocalSocket*>(QObject::sender());
+    if (s) {
+        m_clients.remove(s);
+        s->deleteLater();
+    }
+}
+
+void EventGateway::on_ready_read() {
+    QLocalSocket *s = qobject_cast<QLocalSocket*>(QObject::sender());
+    if (!s || !m_clients.contains(s)) {
+        return;
+    }
+    QByteArray &in = m_clients[s].in;
+    in.append(s->readAll());
+    while (in.size() >= 4) {
+        QDataStream len_stream(in);
+        quint32 len;
+        len_stream >> len;
+        if (len < 5 || len > MAX_CLIENT_FRAME) {
+            qWarning() << "gateway client sent a bad frame, dropping it";
+            in.clear();
+            s->disconnectFromServer();
+            return;
+        }
+        if (quint32(in.size()) < 4 + len) {
+            break; // wait for the rest
+        }
+        QByteArray f = in.mid(4, len);
+        in.remove(0, 4 + len);
+        handle_frame(s, f); // may replay a lot, s stays valid until we return
+    }
+}
+
+void EventGateway::handle_frame(QLocalSocket *s, const QByteArray &f) {
+    QDataStream data(f);
+    quint8 type;
+    quint32 room_id;
+    data >> type >> room_id;
+    QString text = QString::fromUtf8(f.mid(5));
+
+    if (type == Subscribe) {
+        Client &c = m_clients[s];
+        if (room_id == 0) {
+            c.all_rooms = true;
+            foreach(quint32 id, m_history.keys()) {
+                replay(s, id, QString()); // ids differ between rooms
+            }
+        } else {
+            c.rooms.insert(room_id);
+            replay(s, room_id, text);
+        }
+    } else if (type == Send) {
+        TalkerRoom *r = room(room_id);
+        if (r) {
+            r->submit_message(text);
+        } else {
+            qWarning() << "gateway client sent to a room we are not in"
+                    << room_id;
+        }
+    } else {
+        qWarning() << "gateway client sent unknown frame type" << type;
+    }
+}
+
+void EventGateway::replay(QLocalSocket *s, const quint32 room_id,
+                          const QString &since) {
+    if (!m_history.contains(room_id)) {
+        send(s, frame(ReplayDone, room_id, QByteArray()));
+        return;
+    }
+    const History &h = m_history[room_id];
+    send(s, frame(Room, room_id, h.name.toUtf8()));
+
+    // start after the client's last event, or at the start of what we
+    // have if we never saw it or it already fell out of the history
+    int start = 0;
+    if (!since.isEmpty()) {
+        int idx = h.ids.lastIndexOf(since);
+        if (idx != -1) {
+            start = idx + 1;
+        }
+    }
+    for (int i = start; i < h.frames.size(); ++i) {
+        send(s, h.frames.at(i));
+    }
+    send(s, frame(ReplayDone, room_id, QByteArray()));
+}
@@ -0,0 +1,109 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef EVENT_GATEWAY_H
+#define EVENT_GATEWAY_H
+
+#include <QtCore>
+#include <QtNetwork>
+
+class TalkerRoom;
+
+/**
+  * Re-publishes the events of the daemon's rooms to local clients over a
+  * QLocalServer (a unix domain socket, or a named pipe on windows), so many
+  * tools can share one upstream connection per room.
+  *
+  * Every frame in both directions is
+  *     quint32 length (big endian, type and payload), quint8 type, payload
+  *
+  * From the gateway:
+  *     Room        quint32 room id, utf8 room name
+  *     Event       quint32 room id, the event exactly as the server sent it
+  *     ReplayDone  quint32 room id, history for a Subscribe is all sent
+  * From a client:
+  *     Subscribe   quint32 room id (0 for every room), utf8 id of the last
+  *                 event the client has (empty for all history we keep)
+  *     Send        quint32 room id, utf8 message to post in the room
+  *
+  * An event frame is built once and the same implicitly shared QByteArray
+  * goes into the history and to every subscriber.
+  */
+class EventGateway : public QObject {
+    Q_OBJECT
+public:
+    enum FrameType {
+        Room = 1,
+        Event = 2,
+        ReplayDone = 3,
+        Subscribe = 16,
+        Send = 17
+    };
+
+    EventGateway(QObject *parent = 0);
+    ~EventGateway();
+
+    bool listen(const QString &name);
+
+    public slots:
+        void add_room(const TalkerRoom *room);
+
+private:
+    struct History {
+        QString name;
+        QQueue<QString> ids; // event id of each frame, may be empty
+        QQueue<QByteArray> frames;
+        qint64 bytes;
+        History() : bytes(0) {}
+    };
+    struct Client {
+        QByteArray in; // partial frame read so far
+        bool all_rooms; // subscribed to every room
+        QSet<quint32> rooms;
+        bool dropped; // too slow, disconnected once we're back in the loop
+        Client() : all_rooms(false), dropped(false) {}
+    };
+
+    QLocalServer *m_server;
+    QHash<quint32, History> m_history; // by room id
+    QHash<QObject*, TalkerRoom*> m_rooms; // rooms we publish
+    QHash<QLocalSocket*, Client> m_clients;
+
+    static QByteArray frame(const FrameType type, const quint32 room_id,
+                            const QByteArray &payload);
+    TalkerRoom *room(const quint32 room_id) const;
+    bool wants(const Client &c, const quint32 room_id) const;
+    void send(QLocalSocket *s, const QByteArray &frame);
+    void replay(QLocalSocket *s, const quint32 room_id, const QString &since);
+    void handle_frame(QLocalSocket *s, const QByteArray &frame);
+
+    private slots:
+        void on_connection();
+        void on_ready_read();
+        void on_client_disconnected();
+        void drop_clients();
+        void on_event(const TalkerRoom *room, const QString &event_id,
+                      const QByteArray &line);
+        void on_room_destroyed(QObject *room);
+};
+
+#endif // EVENT_GATEWAY_H
@@ -0,0 +1,132 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtCore>
+
+#include "event_logger.h"
+#include "talker_room.h"
+
+RotatingLog::RotatingLog(const QString &path, const qint64 max_bytes,
+                         const int keep)
+    : m_path(path)
+    , m_file(path)
+    , m_size(0)
+    , m_max_bytes(max_bytes)
+    , m_keep(keep)
+{
+    open();
+}
+
+RotatingLog::~RotatingLog() {
+    m_file.close();
+}
+
+bool RotatingLog::open() {
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "could not open log" << m_path << m_file.errorString();
+        return false;
+    }
+    m_size = m_file.size();
+    return true;
+}
+
+void RotatingLog::write(const QByteArray &line) {
+    if (!m_file.isOpen() && !open()) {
+        return;
+    }
+    if (m_size + line.size() + 1 > m_max_bytes && m_size > 0) {
+        rotate();
+    }
+    m_file.write(line);
+    m_file.write("\n", 1);
+    m_size += line.size() + 1;
+}
+
+void RotatingLog::flush() {
+    m_file.flush();
+}
+
+void RotatingLog::rotate() {
+    m_file.close();
+    QFile::remove(QString("%1.%2").arg(m_path).arg(m_keep));
+    for (int i = m_keep - 1; i >= 1; --i) {
+        QFile::rename(QString("%1.%2").arg(m_path).arg(i),
+                      QString("%1.%2").arg(m_path).arg(i + 1));
+    }
+    if (m_keep > 0) {
+        QFile::rename(m_path, m_path + ".1");
+    } else {
+        QFile::remove(m_path);
+    }
+    open();
+}
+
+EventLogger::EventLogger(const QString &dir, const qint64 max_bytes,
+                         const int keep, QObject *parent)
+    : QObject(parent)
+    , m_dir(dir)
+    , m_max_bytes(max_bytes)
+    , m_keep(keep)
+    , m_timer(new QTimer(this))
+{
+    QDir().mkpath(m_dir);
+    connect(m_timer, SIGNAL(timeout()), SLOT(flush()));
+    m_timer->start(1000);
+}
+
+EventLogger::~EventLogger() {
+    qDeleteAll(m_logs);
+}
+
+void EventLogger::add_room(const TalkerRoom *room) {
+    QObject *key = const_cast<TalkerRoom*>(room);
+    if (m_logs.contains(key)) {
+        return;
+    }
+    // account and room ids keep names unique and safe for any filesystem
+    QString path = QString("%1/%2_room_%3.log").arg(m_dir)
+                   .arg(room->account()->domain()).arg(room->id());
+    m_logs.insert(key, new RotatingLog(path, m_max_bytes, m_keep));
+    connect(room,
+            SIGNAL(event_received(const TalkerRoom*,QString,QByteArray)),
+            SLOT(on_event(const TalkerRoom*,QString,QByteArray)));
+    connect(room, SIGNAL(destroyed(QObject*)),
+            SLOT(on_room_destroyed(QObject*)));
+}
+
+void EventLogger::flush() {
+    foreach(RotatingLog *log, m_logs) {
+        log->flush();
+    }
+}
+
+void EventLogger::on_event(const TalkerRoom *room, const QString &,
+                           const QByteArray &line) {
+    RotatingLog *log = m_logs.value(const_cast<TalkerRoom*>(room));
+    if (log) {
+        log->write(line);
+    }
+}
+
+void EventLogger::on_room_destroyed(QObject *room) {
+    delete m_logs.take(room);
+}
@@ -0,0 +1,82 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef EVENT_LOGGER_H
+#define EVENT_LOGGER_H
+
+#include <QtCore>
+
+class TalkerRoom;
+
+/**
+  * Append-only log file that is moved aside once it reaches a size limit.
+  * The current file is <path>, older ones are <path>.1 (newest) up to
+  * <path>.<keep>, anything older than that is deleted.
+  */
+class RotatingLog {
+public:
+    RotatingLog(const QString &path, const qint64 max_bytes, const int keep);
+    ~RotatingLog();
+
+    void write(const QByteArray &line); // one line, the newline is added
+    void flush();
+
+private:
+    QString m_path;
+    QFile m_file; // buffered by QFile, flushed by the logger's timer
+    qint64 m_size; // kept here, QFile::size() would flush the buffer
+    qint64 m_max_bytes;
+    int m_keep;
+
+    bool open();
+    void rotate();
+};
+
+/**
+  * Writes every event of the rooms it is given to one rotating log per
+  * room, exactly as the server sent them.
+  */
+class EventLogger : public QObject {
+    Q_OBJECT
+public:
+    EventLogger(const QString &dir, const qint64 max_bytes, const int keep,
+                QObject *parent = 0);
+    ~EventLogger();
+
+    public slots:
+        void add_room(const TalkerRoom *room);
+        void flush();
+
+private:
+    QString m_dir;
+    qint64 m_max_bytes; // per file
+    int m_keep; // rotated files kept per room
+    QHash<QObject*, RotatingLog*> m_logs; // keyed by room
+    QTimer *m_timer; // flushes every log once a second
+
+    private slots:
+        void on_event(const TalkerRoom *room, const QString &event_id,
+                      const QByteArray &line);
+        void on_room_destroyed(QObject *room);
+};
+
+#endif // EVENT_LOGGER_H
@@ -0,0 +1,156 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtCore>
+#include <csignal>
+
+#include "defines.h"
+#include "event_logger.h"
+#include "event_gateway.h"
+#include "talker_daemon.h"
+
+// set from the signal handler, polled from the event loop
+static volatile sig_atomic_t s_stop = 0;
+
+static void on_signal(int) {
+    s_stop = 1;
+}
+
+/**
+  * Turns SIGINT and SIGTERM into a clean shutdown, Qt can't be called from
+  * the handler itself
+  */
+class StopWatcher : public QObject {
+public:
+    StopWatcher(TalkerDaemon *daemon) : QObject(daemon), m_daemon(daemon) {
+        startTimer(250);
+    }
+
+protected:
+    void timerEvent(QTimerEvent *) {
+        if (s_stop) {
+            m_daemon->shutdown();
+        }
+    }
+
+private:
+    TalkerDaemon *m_daemon;
+};
+
+static void usage() {
+    QTextStream out(stderr);
+    out << "usage: talker_daemon [options]\n"
+        << "  --log-dir DIR     where room logs go (default: logs next to "
+           "the settings)\n"
+        << "  --max-size MB     size a log grows to before it is rotated "
+           "(default 64)\n"
+        << "  --keep N          rotated logs kept per room (default 10)\n"
+        << "  --no-logs         don't write room logs\n"
+        << "  --gateway NAME    pass events on to local clients through the "
+           "local socket NAME\n"
+        << "  --rooms A,B       also join these rooms by name\n"
+        << "  --all-rooms       join every room of every account\n"
+        << "  --help            show this and exit\n";
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+    // same settings as the GUI so the configured accounts are found
+    QCoreApplication::setOrganizationName("UDPSoftware");
+    QCoreApplication::setOrganizationDomain("udpviper.com");
+    QCoreApplication::setApplicationName("SmoothTalker");
+    QCoreApplication::setApplicationVersion(ST_VERSION);
+
+    QString log_dir;
+    qint64 max_size = 64;
+    int keep = 10;
+    QStringList rooms;
+    bool all_rooms = false;
+    bool logs = true;
+    QString gateway_name;
+
+    QStringList args = a.arguments();
+    for (int i = 1; i < args.size(); ++i) {
+        QString arg = args.at(i);
+        QString value = args.value(i + 1);
+        if (arg == "--help" || arg == "-h") {
+            usage();
+            return 0;
+        } else if (arg == "--all-rooms") {
+            all_rooms = true;
+            continue; // no value
+        } else if (arg == "--no-logs") {
+            logs = false;
+            continue; // no value
+        } else if (arg == "--gateway") {
+            gateway_name = value;
+        } else if (arg == "--log-dir") {
+            log_dir = value;
+        } else if (arg == "--max-size") {
+            max_size = value.toLongLong();
+        } else if (arg == "--keep") {
+            keep = value.toInt();
+        } else if (arg == "--rooms") {
+            rooms = value.split(',', QString::SkipEmptyParts);
+        } else {
+            usage();
+            return 1;
+        }
+        ++i;
+    }
+    if (max_size < 1 || keep < 0 || (!logs && gateway_name.isEmpty())) {
+        usage();
+        return 1;
+    }
+
+    if (log_dir.isEmpty()) {
+        QSettings s(QSettings::IniFormat, QSettings::UserScope,
+                    QCoreApplication::organizationName(),
+                    QCoreApplication::applicationName());
+        log_dir = QFileInfo(s.fileName()).absolutePath() + "/logs";
+    }
+
+    TalkerDaemon daemon;
+    if (logs) {
+        daemon.set_logger(new EventLogger(log_dir, max_size * 1024 * 1024,
+                                          keep, &daemon));
+        qDebug() << "logging room events to" << log_dir;
+    }
+    if (!gateway_name.isEmpty()) {
+        EventGateway *gateway = new EventGateway(&daemon);
+        if (!gateway->listen(gateway_name)) {
+            return 1;
+        }
+        daemon.set_gateway(gateway);
+    }
+    daemon.set_join_all(all_rooms);
+    daemon.set_rooms(rooms);
+    new StopWatcher(&daemon);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    if (daemon.start() < 1) {
+        qWarning() << "no accounts configured, add one in SmoothTalker first";
+        return 1;
+    }
+    return a.exec();
+}
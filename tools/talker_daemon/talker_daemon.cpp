@@ -0,0 +1,225 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <QtCore>
+#include <QtNetwork>
+
+#include "talker_daemon.h"
+#include "event_logger.h"
+#include "event_gateway.h"
+#include "talker_account.h"
+#include "talker_room.h"
+#include "settings_store.h"
+#include "event_journal.h"
+#include "metrics.h"
+
+// how long to wait before joining a room that dropped again, doubled for
+// every rejoin in a row that fails up to the maximum
+static const int REJOIN_DELAY_MS = 5000;
+static const int MAX_REJOIN_DELAY_MS = 5 * 60 * 1000;
+// how often caches are trimmed
+static const int TRIM_INTERVAL_MS = 10 * 60 * 1000;
+
+TalkerDaemon::TalkerDaemon(QObject *parent)
+    : QObject(parent)
+    , m_store(new SettingsStore(this))
+    , m_journal(new EventJournal(QFileInfo(m_store->settings()->fileName())
+                                 .absolutePath() + "/daemon_journal.log",
+                                 this))
+    , m_logger(0)
+    , m_gateway(0)
+    , m_metrics(0)
+    , m_net(new QNetworkAccessManager(this))
+    , m_join_all(false)
+    , m_stopping(false)
+    , m_trim_timer(new QTimer(this))
+{
+    connect(m_trim_timer, SIGNAL(timeout()), SLOT(trim_caches()));
+    // the GUI may use the same rooms, it must not pick up where we are
+    TalkerRoom::set_state_name("daemon");
+}
+
+TalkerDaemon::~TalkerDaemon() {
+    delete m_metrics; // stops its thread
+}
+
+int TalkerDaemon::start() {
+    QSettings *s = m_store->settings();
+    int total_accounts = s->beginReadArray("accounts");
+    for (int i = 0; i < total_accounts; ++i) {
+        s->setArrayIndex(i);
+        TalkerAccount *a = new TalkerAccount("", "", "", this);
+        a->load_settings(*s);
+        a->set_network(m_net);
+        a->set_fetch_avatars(false); // nothing here shows them
+        connect(a, SIGNAL(new_rooms_available(const TalkerAccount&)),
+                SLOT(on_rooms_available(const TalkerAccount&)));
+        connect(a, SIGNAL(choose_rooms(const TalkerAccount&)),
+                SLOT(on_choose_rooms(const TalkerAccount&)));
+        connect(a, SIGNAL(room_connected(const TalkerRoom*)),
+                SLOT(on_room_connected(const TalkerRoom*)));
+        connect(a, SIGNAL(room_disconnected(int)),
+                SLOT(on_room_disconnected(int)));
+        connect(a, SIGNAL(new_status_message(QString)),
+                SLOT(log_status(QString)));
+        connect(a, SIGNAL(error(QString,QString)),
+                SLOT(log_error(QString,QString)));
+        m_accounts.append(a);
+    }
+    s->endArray();
+
+    OptionsPtr opts = m_store->options();
+    if (opts->metrics_enabled) {
+        new StallMonitor(this);
+        m_metrics = new MetricsServer(opts->metrics_port);
+        m_metrics->start();
+    }
+
+    foreach(TalkerAccount *a, m_accounts) {
+        a->get_available_rooms();
+    }
+    m_trim_timer->start(TRIM_INTERVAL_MS);
+    return m_accounts.size();
+}
+
+TalkerAccount *TalkerDaemon::account_for(const QObject *sender) const {
+    foreach(TalkerAccount *a, m_accounts) {
+        if (a == sender) {
+            return a;
+        }
+    }
+    return 0;
+}
+
+void TalkerDaemon::on_rooms_available(const TalkerAccount &acct) {
+    TalkerAccount *a = account_for(&acct);
+    if (!a || m_stopping) {
+        return;
+    }
+    // open_room skips rooms that are already open
+    QMap<QString, int> rooms = acct.avail_rooms();
+    foreach(QString name, rooms.keys()) {
+        if (m_join_all || m_rooms.contains(name)) {
+            a->open_room(rooms[name]);
+        }
+    }
+}
+
+void TalkerDaemon::on_choose_rooms(const TalkerAccount &acct) {
+    if (!m_join_all && m_rooms.isEmpty()) {
+        qWarning() << acct.to_str() << "had no rooms open last session, "
+                "use --all-rooms or --rooms to pick some";
+    }
+}
+
+void TalkerDaemon::on_room_connected(const TalkerRoom *room) {
+    // joined again, the next drop starts over at the shortest delay
+    QPair<const TalkerAccount*, int> key(account_for(QObject::sender()),
+                                         room->id());
+    m_rejoins.remove(key);
+    if (m_logger) {
+        m_logger->add_room(room);
+    }
+    if (m_gateway) {
+        m_gateway->add_room(room);
+    }
+}
+
+void TalkerDaemon::on_room_disconnected(const int room_id) {
+    if (m_stopping) {
+        return;
+    }
+    // the room is only deleted once we are back in the event loop, try
+    // again once it is gone; this also runs when the connect failed, so
+    // back off while the network or the server is down
+    TalkerAccount *a = account_for(QObject::sender());
+    if (a) {
+        QPair<const TalkerAccount*, int> key(a, room_id);
+        int tries = m_rejoins.value(key);
+        m_rejoins.insert(key, tries + 1);
+        int delay = REJOIN_DELAY_MS;
+        while (tries-- > 0 && delay < MAX_REJOIN_DELAY_MS) {
+            delay *= 2;
+        }
+        delay = qMin(delay, MAX_REJOIN_DELAY_MS);
+
+        QTimer *t = new QTimer(a);
+        t->setSingleShot(true);
+        t->setProperty("room_id", room_id);
+        connect(t, SIGNAL(timeout()), SLOT(rejoin()));
+        t->start(delay);
+    }
+}
+
+void TalkerDaemon::rejoin() {
+    QTimer *t = qobject_cast<QTimer*>(QObject::sender());
+    if (!t) {
+        return;
+    }
+    TalkerAccount *a = qobject_cast<TalkerAccount*>(t->parent());
+    if (a && !m_stopping) {
+        int room_id = t->property("room_id").toInt();
+        QPair<const TalkerAccount*, int> key(a, room_id);
+        log_status(tr("%1: rejoining room %2, try %3").arg(a->name())
+                   .arg(room_id).arg(m_rejoins.value(key)));
+        a->open_room(room_id);
+    }
+    t->deleteLater();
+}
+
+void TalkerDaemon::trim_caches() {
+    foreach(TalkerAccount *a, m_accounts) {
+        a->trim_caches();
+    }
+}
+
+void TalkerDaemon::shutdown() {
+    if (m_stopping) {
+        return;
+    }
+    m_stopping = true;
+    log_status(tr("shutting down..."));
+    foreach(TalkerAccount *a, m_accounts) {
+        a->logout();
+    }
+    // give the sockets a moment to close and the rooms to save
+    QTimer::singleShot(1000, this, SLOT(finish_shutdown()));
+}
+
+void TalkerDaemon::finish_shutdown() {
+    if (m_logger) {
+        m_logger->flush();
+    }
+    m_journal->flush();
+    m_store->flush();
+    QCoreApplication::quit();
+}
+
+void TalkerDaemon::log_status(const QString &msg) {
+    QTextStream err(stderr);
+    err << QDateTime::currentDateTime().toString(Qt::ISODate) << " " << msg
+        << "\n";
+}
+
+void TalkerDaemon::log_error(const QString &title, const QString &message) {
+    log_status(QString("%1 %2").arg(title).arg(message));
+}
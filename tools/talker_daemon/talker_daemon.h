@@ -0,0 +1,91 @@
+/*
+SmoothTalker
+Copyright (c) 2010 Trey Stout (chmod)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef TALKER_DAEMON_H
+#define TALKER_DAEMON_H
+
+#include <QtCore>
+#include <QtNetwork>
+
+class TalkerAccount;
+class TalkerRoom;
+class SettingsStore;
+class EventJournal;
+class EventLogger;
+class EventGateway;
+class MetricsServer;
+
+/**
+  * Logs into every configured account without any widgets, joins rooms and
+  * hands their events to an EventLogger and/or an EventGateway. Rooms that
+  * drop or fail to connect are joined again, waiting longer after each try
+  * that fails.
+  */
+class TalkerDaemon : public QObject {
+    Q_OBJECT
+public:
+    TalkerDaemon(QObject *parent = 0);
+    ~TalkerDaemon();
+
+    void set_logger(EventLogger *logger) {m_logger = logger;}
+    void set_gateway(EventGateway *gateway) {m_gateway = gateway;}
+
+    // join every room of each account instead of only last session's rooms
+    void set_join_all(const bool all) {m_join_all = all;}
+    // also join these rooms by name
+    void set_rooms(const QStringList &rooms) {m_rooms = rooms;}
+
+    int start(); // log in, returns how many accounts were found
+
+    public slots:
+        void shutdown(); // log out and quit once the rooms are saved
+
+private:
+    SettingsStore *m_store; // options and the accounts
+    EventJournal *m_journal; // last event ids, apart from the GUI's
+    EventLogger *m_logger; // writes events to disk, if set
+    EventGateway *m_gateway; // passes events on to local clients, if set
+    MetricsServer *m_metrics; // only set when the metrics endpoint is on
+    QNetworkAccessManager *m_net; // shared by all accounts
+    QList<TalkerAccount*> m_accounts;
+    bool m_join_all;
+    QStringList m_rooms;
+    bool m_stopping; // rooms that drop now are not rejoined
+    // rejoins tried since each room was last connected, per account
+    QHash<QPair<const TalkerAccount*, int>, int> m_rejoins;
+    QTimer *m_trim_timer; // keeps long running memory flat
+
+    TalkerAccount *account_for(const QObject *sender) const;
+
+    private slots:
+        void on_rooms_available(const TalkerAccount &acct);
+        void on_choose_rooms(const TalkerAccount &acct);
+        void on_room_connected(const TalkerRoom *room);
+        void on_room_disconnected(const int room_id);
+        void rejoin();
+        void trim_caches();
+        void finish_shutdown();
+        void log_status(const QString &msg);
+        void log_error(const QString &title, const QString &message);
+};
+
+#endif // TALKER_DAEMON_H
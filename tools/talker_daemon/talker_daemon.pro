@@ -0,0 +1,63 @@
+# -------------------------------------------------
+# Headless client that logs every event of its rooms to rotating files and
+# can share its room connections with local clients
+#   qmake && make && ./talker_daemon --all-rooms
+# -------------------------------------------------
+# QT libs we need
+QT += network \
+    script
+QT -= gui
+
+# basic app config
+TARGET = talker_daemon
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+debug:DESTDIR = ../../bin/debug
+release:DESTDIR = ../../bin/release
+
+# where to put all the temporary crap
+OBJECTS_DIR = ../../bin/temp/talker_daemon
+MOC_DIR = ../../bin/temp/talker_daemon
+RCC_DIR = ../../bin/temp/talker_daemon
+
+# the protocol core of the app is built in as-is, none of it needs QtGui
+DEPENDPATH += ../../inc \
+    ../../src
+INCLUDEPATH += ../../inc
+
+# what files to find
+SOURCES += main.cpp \
+    talker_daemon.cpp \
+    event_logger.cpp \
+    event_gateway.cpp \
+    ../../src/talker_account.cpp \
+    ../../src/talker_room.cpp \
+    ../../src/talker_user.cpp \
+    ../../src/settings_store.cpp \
+    ../../src/event_journal.cpp \
+    ../../src/event_filter.cpp \
+    ../../src/process_stats.cpp \
+    ../../src/wire_capture.cpp \
+    ../../src/latency_tracer.cpp \
+    ../../src/json_string.cpp \
+    ../../src/metrics.cpp \
+    ../../src/highlight_matcher.cpp
+HEADERS += talker_daemon.h \
+    event_logger.h \
+    event_gateway.h \
+    ../../inc/talker_account.h \
+    ../../inc/talker_room.h \
+    ../../inc/talker_user.h \
+    ../../inc/settings_store.h \
+    ../../inc/event_journal.h \
+    ../../inc/event_filter.h \
+    ../../inc/process_stats.h \
+    ../../inc/wire_capture.h \
+    ../../inc/latency_tracer.h \
+    ../../inc/json_string.h \
+    ../../inc/memory_usage.h \
+    ../../inc/metrics.h \
+    ../../inc/highlight_matcher.h \
+    ../../inc/defines.h
+win32:LIBS += -lpsapi # process memory stats